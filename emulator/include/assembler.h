@@ -0,0 +1,34 @@
+#ifndef CHIPPY_ASSEMBLER_H
+#define CHIPPY_ASSEMBLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Two pass assembler for the mnemonics Disassemble prints. Disassembly of
+    a defined encoding assembles back to the same bytes. Fields the emulator
+    ignores are not printed and come back clear: Vy of SHR and SHL (8XY6,
+    8XYE) and n of 5XYn and 9XYn, so those still run the same. See
+    tests/assembler_test.c.
+
+    One statement per line, code starts at 0x200:
+
+        ; comment
+        loop:   LD V0, 0x10      ; numbers are decimal or 0x hex, -1 is 0xFF for bytes
+                ADD I, V0
+                JP loop          ; label or label+N wherever a number goes
+                DB 0xF0, 0x90    ; raw bytes
+                DW 0x1234        ; raw big endian word
+
+    Mnemonics and registers are case insensitive, labels are not.
+*/
+
+#define ASSEMBLER_MAX_LABELS 512U
+#define ASSEMBLER_MAX_LABEL 32U
+
+// Assemble source into out, capacity bytes at most. On failure returns false
+// with "line N: reason" in message
+bool Assemble(const char* source, uint8_t* out, size_t capacity, size_t* length, char* message, size_t message_size);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef CHIPPY_CAPTURE_H
+#define CHIPPY_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "chip8.h"
+
+/*
+    Captures write the chip8 framebuffer to disk once per 60Hz frame.
+    Repeats are folded into a run length on the frame that is still
+    pending, so raw and gif only store frames that differ from the last.
+
+    Formats (picked from the file extension):
+        .raw  "CH8R" u16 width u16 height, then per frame u32 repeat + 1bpp pixels
+        .y4m  YUV4MPEG2 at 60 fps, a held frame is written again for every frame it stays up
+        .gif  Animated GIF89a, repeats become the frame delay
+*/
+
+typedef enum {
+    CAPTURE_RAW,
+    CAPTURE_Y4M,
+    CAPTURE_GIF
+} CaptureFormat;
+
+typedef struct {
+    FILE* file;
+    CaptureFormat format;
+    int scale;
+    int width;
+    int height;
+    uint8_t frame[CHIP8_VIDEO_BYTES];
+    uint32_t repeat;
+    uint64_t ticks;
+    uint64_t centiseconds;
+    uint8_t* pixels;
+    uint16_t* lzw;
+} Capture;
+
+// Open a capture file, the format comes from the extension
+void OpenCapture(Capture* capture, const char* path, int scale);
+
+// Feed one 60Hz frame, only written once a different frame arrives
+void CaptureFrame(Capture* capture, Chip8 const* chip);
+
+// Flush the pending frame and finish the file
+void CloseCapture(Capture* capture);
+
+#endif
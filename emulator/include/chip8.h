@@ -8,10 +8,38 @@
 #define CHIP8_VIDEO_SIZE (64U * 32U)
 #define CHIP8_VIDEO_WIDTH 64U
 #define CHIP8_VIDEO_HEIGHT 32U
+#define CHIP8_VIDEO_BYTES (CHIP8_VIDEO_SIZE / 8U)
+#define CHIP8_PAGE_SIZE 256U
+#define CHIP8_PAGE_COUNT (CHIP8_MEMORY_SIZE / CHIP8_PAGE_SIZE)
 
+// Optional memory watchpoints, see watch.h
+struct watch;
+
+// Font and rom as loaded, read only, any number of machines can run from one
+typedef struct {
+    uint8_t memory[CHIP8_MEMORY_SIZE];
+    // Superinstruction kind starting at each address, see Chip8Run
+    uint8_t fusion[CHIP8_MEMORY_SIZE];
+} Chip8Image;
+
+// A page of memory a machine wrote, with its own fusion kinds
+struct chip8_page;
+
+/*
+    Guest memory is paged. A page points into the image until its first write
+    gives the machine its own copy from a pool shared by every machine, so a
+    machine only owns the pages it changed. Give them back with Chip8Release.
+*/
 typedef struct chip8 {
     uint8_t registers[16];
-    uint8_t memory[CHIP8_MEMORY_SIZE];
+    uint8_t const* pages[CHIP8_PAGE_COUNT];
+    // Fusion kinds for each page, the image's while the page is shared
+    uint8_t const* fusion[CHIP8_PAGE_COUNT];
+    // The machine's own copy of each page, NULL while shared
+    struct chip8_page* private_pages[CHIP8_PAGE_COUNT];
+    Chip8Image const* image;
+    Rom* rom;
+    struct watch* watch;
     uint16_t stack[16];
     uint16_t index;
     uint16_t pc;
@@ -19,19 +47,83 @@ typedef struct chip8 {
     uint8_t delay_timer;
     uint8_t sound_timer;
     uint8_t keypad[16];
+    // Bit per key looked at by EX9E, EXA1 or FX0A, only ever set, owners of the keypad clear it
+    uint16_t keys_read;
     uint32_t video[CHIP8_VIDEO_SIZE];
-    Rom* rom;
+    // CXKK random source, per machine so runs replay from a seed
+    uint32_t rng;
+#if defined(CHIPPY_STATE_HASH)
+    // Running state hash, video kept apart so a clear is O(1)
+    uint64_t hash;
+    uint64_t video_hash;
+#endif
 } Chip8;
 
+// Everything that defines a running machine, compact enough to keep lots of them around
+typedef struct {
+    uint8_t registers[16];
+    uint8_t memory[CHIP8_MEMORY_SIZE];
+    uint16_t stack[16];
+    uint16_t index;
+    uint16_t pc;
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t keypad[16];
+    uint32_t rng;
+    uint8_t video[CHIP8_VIDEO_BYTES];
+} Chip8State;
+
 // Init Chip8
 void Chip8Init(Chip8* chip);
 
-// Load rom into chip8 memory
+// Give the private pages back to the pool, before freeing the machine or
+// another Chip8Init. Does nothing on a zeroed machine
+void Chip8Release(Chip8* chip);
+
+// Seed the CXKK random source, Chip8Init seeds from the clock
+void Chip8Seed(Chip8* chip, uint32_t seed);
+
+// Load rom into chip8 memory, the machine gets private copies of the pages it covers
 void Chip8LoadRom(Chip8* chip, Rom* rom);
 
+// Font plus rom on the heap, for machines that share one copy
+Chip8Image* Chip8CreateImage(Rom const* rom);
+void Chip8DestroyImage(Chip8Image** image);
+
+// Run from a shared image instead, nothing is copied until written. The
+// image has to outlive the machine
+void Chip8LoadImage(Chip8* chip, Chip8Image const* image);
+
+// Read guest memory from outside the instruction handlers
+static inline uint8_t Chip8Peek(Chip8 const* chip, uint16_t address) {
+    address &= CHIP8_MEMORY_SIZE - 1;
+    return chip->pages[address / CHIP8_PAGE_SIZE][address % CHIP8_PAGE_SIZE];
+}
+
 // Run the emulator in the fetch, decode, execute cycle
 // Memory, Sound and other peripherals are all updated accordingly
 void Chip8Cycle(Chip8* chip);
 
+// Decrement the delay and sound timers, call once per emulated 60Hz frame
+void Chip8TickTimers(Chip8* chip);
+
+// Run up to budget instructions with common sequences fused into one dispatch
+// Returns how many instructions ran, the same state as that many Chip8Cycle calls
+uint32_t Chip8Run(Chip8* chip, uint32_t budget);
+
+// Pack the framebuffer into 1bpp, msb first, CHIP8_VIDEO_BYTES long
+void Chip8PackVideo(Chip8 const* chip, uint8_t* out);
+
+// Snapshot and restore the machine, the rom, image, watch and caches stay with the chip.
+// Restored pages equal to the ones the machine started from go back to sharing them
+void Chip8SaveState(Chip8 const* chip, Chip8State* state);
+void Chip8LoadState(Chip8* chip, Chip8State const* state);
+
+// 64 bit hash of the machine state (keypad excluded, it is input not state)
+// Equal states hash equal across instances and runs. O(1) when built with
+// CHIPPY_STATE_HASH, a walk over the whole state otherwise
+uint64_t Chip8HashState(Chip8 const* chip);
+
 #endif
 
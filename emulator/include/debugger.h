@@ -0,0 +1,81 @@
+#ifndef CHIPPY_DEBUGGER_H
+#define CHIPPY_DEBUGGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+#include "trace.h"
+
+/*
+    Interactive debugger on stdin/stdout.
+
+    Only the debug engine variant (DebuggerCycle) looks at breakpoints, the
+    normal Chip8Cycle loop has no hooks at all. Breakpoints live in a 4096 bit
+    pc bitmap so the check per instruction is a single bit test.
+
+    When chip->watch is set the debug engine also marks executed code and
+    reports watchpoint hits, stopping at the prompt when interactive.
+    With a trace attached every instruction is recorded into its ring.
+
+    Commands:
+        b <addr> [vX <op> <value>]  break at addr, optionally only when the condition holds (op: == != < > <= >=)
+        d <addr>                    delete breakpoints at addr
+        l                           list breakpoints
+        s [n]                       step n instructions
+        n                           step over a CALL
+        c                           continue
+        r                           dump registers, timers and stack
+        m <addr> [len]              dump memory
+        w <r|w|rw> <addr> [end]     watch reads and/or writes of a range
+        q                           quit
+*/
+
+#define DEBUGGER_MAX_CONDITIONS 64U
+
+typedef enum {
+    CONDITION_EQ,
+    CONDITION_NE,
+    CONDITION_LT,
+    CONDITION_GT,
+    CONDITION_LE,
+    CONDITION_GE
+} ConditionOp;
+
+typedef struct {
+    uint16_t address;
+    uint8_t reg;
+    uint8_t value;
+    ConditionOp op;
+} BreakCondition;
+
+typedef enum {
+    DEBUGGER_RUN,
+    DEBUGGER_STEP,
+    DEBUGGER_NEXT
+} DebuggerMode;
+
+typedef struct {
+    // Any breakpoint at this pc
+    uint64_t breakpoints[CHIP8_MEMORY_SIZE / 64];
+    // Breakpoints at this pc that always stop
+    uint64_t unconditional[CHIP8_MEMORY_SIZE / 64];
+    BreakCondition conditions[DEBUGGER_MAX_CONDITIONS];
+    uint32_t condition_count;
+
+    DebuggerMode mode;
+    uint32_t steps;
+    uint16_t next_address;
+    uint8_t next_sp;
+    bool interactive;
+    bool quit;
+    Trace* trace;
+} Debugger;
+
+// Init the debugger, when interactive the prompt comes up before the first instruction
+// otherwise it only runs the debug engine to report watchpoints
+void InitDebugger(Debugger* debugger, bool interactive);
+
+// Debug engine variant of Chip8Cycle, returns false once the user quits
+bool DebuggerCycle(Debugger* debugger, Chip8* chip);
+
+#endif
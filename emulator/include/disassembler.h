@@ -0,0 +1,10 @@
+#ifndef CHIPPY_DISASSEMBLER_H
+#define CHIPPY_DISASSEMBLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Write the mnemonic for an opcode, e.g. 0x6A02 -> "LD VA, 0x02" */
+void Disassemble(uint16_t opcode, char* out, size_t size);
+
+#endif
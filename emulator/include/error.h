@@ -6,5 +6,8 @@
 
 void error(const char* msg);
 
-#endif
+// Called by error() on the same thread before exiting, e.g. to flush a trace. NULL to clear.
+// A handler that longjmps out instead of returning keeps the process alive
+void SetErrorHandler(void (*handler)(void* data), void* data);
 
+#endif
@@ -0,0 +1,80 @@
+#ifndef CHIPPY_FILTER_H
+#define CHIPPY_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "SDL.h"
+
+/*
+    CPU post processing for the display, a chain like "hq2x,crt".
+
+    Scalers, applied in order on the 64x32 framebuffer:
+        scale2x  EPX, corners take the neighbour colour where two edges meet
+        hq2x     scale2x with the corner blended 3:1 towards the neighbour
+                 instead of replaced, hqx style smoothing without the hqx tables
+        hq4x     hq2x twice
+    The last stage always stretches to the window size, darkening every other
+    row and dimming two of the three colour channels per column when "crt" is
+    in the list.
+
+    Each stage is split into bands of rows run by a pool of SDL threads plus
+    the caller. Inner loops are branch free over packed RGBA so the compiler
+    can vectorise them. A frame identical to the last one is not filtered again.
+*/
+
+#define FILTER_MAX_STAGES 8U
+
+typedef enum {
+    FILTER_SCALE2X,
+    FILTER_HQ2X,
+    FILTER_FIT
+} FilterKind;
+
+typedef struct {
+    FilterKind kind;
+    int in_width;
+    int in_height;
+    int out_width;
+    int out_height;
+    uint32_t const* in;
+    uint32_t* out;
+} FilterStage;
+
+typedef struct {
+    FilterStage stages[FILTER_MAX_STAGES];
+    uint32_t stage_count;
+    bool crt;
+
+    // Fit stage lookups, source column per output column and the crt mask per column
+    int* columns;
+    uint32_t* mask;
+
+    uint32_t* buffers[FILTER_MAX_STAGES];
+    uint32_t* last;
+    bool filtered;
+
+    // Final image, width x height
+    uint32_t* output;
+    int width;
+    int height;
+
+    // Worker pool, the current stage is handed out in bands
+    SDL_Thread** workers;
+    int thread_count;
+    SDL_sem* start;
+    SDL_sem* done;
+    SDL_atomic_t next_band;
+    int band_count;
+    uint32_t current;
+    bool quit;
+} Filter;
+
+// Build the chain for list, output width x height. threads 0 uses every core
+void InitFilter(Filter* filter, const char* list, int width, int height, int threads);
+
+// Run the chain on a 64x32 framebuffer, returns false if it matched the last one and output was kept
+bool FilterFrame(Filter* filter, uint32_t const* video);
+
+void DestroyFilter(Filter* filter);
+
+#endif
@@ -3,17 +3,39 @@
 
 #include <stdbool.h>
 #include "SDL.h"
+#include "filter.h"
+#include "latency.h"
 
 typedef struct {
     SDL_Window* window;
     SDL_Renderer* renderer;
     SDL_Texture* texture;
+    // Optional CPU filter chain, the texture then has the filter's output size
+    Filter* filter;
+    // Text drawn over the top left corner, NULL for none
+    const char* overlay;
+    int height;
 } Gui;
 
+// Hotkeys handled by ProcessInput besides the keypad
+typedef struct {
+    // Tab toggles running unthrottled
+    bool turbo;
+    // F8 asks for the latency report, the caller clears it
+    bool report_latency;
+    // F3 toggles the metrics overlay
+    bool overlay;
+} Hotkeys;
+
 void InitGui(Gui* gui, const char* title, int width, int height, int twidth, int theight);
 void DestroyGui(Gui* gui);
 void UpdateGui(Gui* gui, void const* buffer, int pitch);
-bool ProcessInput(uint8_t* keys);
+// Upload only rect of the texture, buffer points at its top left, then present. NULL uploads nothing
+void UpdateGuiRect(Gui* gui, SDL_Rect const* rect, void const* buffer, int pitch);
+// Filter every frame through filter before upload, NULL for the plain stretch
+void SetGuiFilter(Gui* gui, Filter* filter);
+// Apply pending events to keys and hotkeys, keypad changes go to latency unless NULL
+bool ProcessInput(uint8_t* keys, Hotkeys* hotkeys, Latency* latency);
 
 #endif
 
@@ -0,0 +1,65 @@
+#ifndef CHIPPY_LATENCY_H
+#define CHIPPY_LATENCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SDL.h"
+#include "chip8.h"
+
+/*
+    Input to photon latency of the window front end.
+
+    Every keypad change is stamped when ProcessInput takes it off the SDL
+    queue and followed through
+        keypad   the first emulated frame to start with the new keypad
+        read     the end of the first frame where EX9E, EXA1 or FX0A looked
+                 at that key
+        photon   the SDL_RenderPresent after that frame
+    each measured from the stamp. A change replaced by the next change of the
+    same key before it was read is counted as unread. The last LATENCY_SAMPLES
+    changes make up the percentiles.
+*/
+
+#define LATENCY_SAMPLES 4096U
+
+typedef enum {
+    LATENCY_KEYPAD,
+    LATENCY_READ,
+    LATENCY_PHOTON,
+    LATENCY_STAGES
+} LatencyStage;
+
+typedef struct {
+    // Performance counter when the change arrived, 0 when nothing is pending
+    Uint64 received;
+    // Stages reached so far
+    uint32_t reached;
+} LatencyKey;
+
+typedef struct {
+    LatencyKey keys[16];
+    Uint64 frequency;
+
+    // Microseconds per stage, rings of LATENCY_SAMPLES
+    uint32_t* samples[LATENCY_STAGES];
+    uint64_t counts[LATENCY_STAGES];
+    unsigned long unread;
+} Latency;
+
+void InitLatency(Latency* latency);
+
+// The keypad entry key changed, call as the event is taken off the queue
+void LatencyKeyChanged(Latency* latency, uint32_t key);
+
+// A frame that began at started ran, clears chip->keys_read
+void LatencyFrame(Latency* latency, Chip8* chip, Uint64 started);
+
+// Call right after SDL_RenderPresent
+void LatencyPresented(Latency* latency);
+
+// Prints p50, p99 and max of each stage to stderr
+void ReportLatency(Latency const* latency);
+
+void DestroyLatency(Latency* latency);
+
+#endif
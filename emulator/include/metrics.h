@@ -0,0 +1,79 @@
+#ifndef CHIPPY_METRICS_H
+#define CHIPPY_METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "SDL.h"
+
+/*
+    Runtime counters, always on. Wall time is charged to whichever phase the
+    front end last switched to, one performance counter read per switch.
+    Once per second the totals become a summary for the overlay and, with
+    --stats, one line appended to the stats file:
+
+        time=<s> ips=<n> frames=<n> presented=<n> skipped=<n>
+        input_ms=<n> run_ms=<n> present_ms=<n> idle_ms=<n>
+        frame_p50_ms=<n> frame_p99_ms=<n> frame_max_ms=<n> frame_hist=<n>,<n>,...
+
+    all on one line, space separated. Counts are for that second only, the
+    last line on close covers whatever is left of the run. run
+    is emulation including timers and frame sinks, present is filtering and
+    SDL rendering. frame times are between presents, frame_hist has a bucket
+    per millisecond and the last one takes everything from METRICS_BUCKETS - 1
+    up, percentiles are the upper edge of their bucket.
+*/
+
+#define METRICS_BUCKETS 33U
+#define METRICS_TEXT_SIZE 160U
+
+typedef enum {
+    METRICS_INPUT,
+    METRICS_RUN,
+    METRICS_PRESENT,
+    METRICS_IDLE,
+    METRICS_PHASES
+} MetricsPhase;
+
+typedef struct {
+    Uint64 frequency;
+    Uint64 started;
+    Uint64 period_start;
+    MetricsPhase phase;
+    Uint64 phase_start;
+
+    // Current period
+    Uint64 phase_ticks[METRICS_PHASES];
+    uint64_t instructions;
+    uint64_t frames;
+    uint64_t presented;
+    Uint64 last_present;
+    Uint64 max_frame;
+    uint32_t histogram[METRICS_BUCKETS];
+
+    // Summary of the last full period, 3 lines for the overlay
+    char text[METRICS_TEXT_SIZE];
+    FILE* file;
+} Metrics;
+
+// Start counting, stats_path gets a line per second unless NULL
+void InitMetrics(Metrics* metrics, const char* stats_path);
+
+// Charge the time since the last switch to the previous phase
+void MetricsSwitch(Metrics* metrics, MetricsPhase phase);
+
+// An emulated frame of instructions finished
+static inline void MetricsFrame(Metrics* metrics, uint32_t instructions) {
+    metrics->frames += 1;
+    metrics->instructions += instructions;
+}
+
+// A frame went to the screen
+void MetricsPresented(Metrics* metrics);
+
+// Close the period once a second has passed, returns true when text changed
+bool MetricsUpdate(Metrics* metrics);
+
+void CloseMetrics(Metrics* metrics);
+
+#endif
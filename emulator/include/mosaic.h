@@ -0,0 +1,46 @@
+#ifndef CHIPPY_MOSAIC_H
+#define CHIPPY_MOSAIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "SDL.h"
+#include "chip8.h"
+
+/*
+    Many machines in one window. Each machine is a 64x32 tile in a grid with
+    a one pixel border between tiles, and all tiles live in one atlas that
+    backs a single streaming texture.
+
+    MosaicUpdate compares each machine's packed frame with the one it drew
+    last and only redraws the tiles that changed. The returned rect bounds
+    them, so one upload of that rect and one copy of the whole atlas is all
+    a refresh costs however many machines there are.
+*/
+
+#define MOSAIC_MAX 4096U
+
+typedef struct {
+    uint32_t count;
+    uint32_t columns;
+    uint32_t rows;
+    // Atlas size in pixels
+    int width;
+    int height;
+    uint32_t* pixels;
+    // Packed frame each tile shows, see Chip8PackVideo
+    uint8_t (*frames)[CHIP8_VIDEO_BYTES];
+    // Tiles redrawn by the last update
+    uint32_t changed;
+    // False until the first update, which uploads the whole atlas
+    bool uploaded;
+} Mosaic;
+
+// Lay out count tiles in a square grid, or as close to one as count allows
+void InitMosaic(Mosaic* mosaic, uint32_t count);
+void DestroyMosaic(Mosaic* mosaic);
+
+// Redraw the tiles of chips whose frames changed, false when none did. dirty
+// bounds the redrawn tiles in atlas pixels
+bool MosaicUpdate(Mosaic* mosaic, Chip8 const* chips, SDL_Rect* dirty);
+
+#endif
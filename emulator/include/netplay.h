@@ -0,0 +1,110 @@
+#ifndef CHIPPY_NETPLAY_H
+#define CHIPPY_NETPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "chip8.h"
+
+/*
+    Two player rollback netplay over UDP, "localport:host:port".
+
+    Both sides run the same rom from NETPLAY_SEED and the keypad of a frame is
+    the or of both players' keys. Each frame the local keys go out as a 16 bit
+    mask and the remote keys are predicted to stay as they were last seen. When
+    the real remote keys of a frame already run turn out different, the machine
+    goes back to the snapshot taken at the start of that frame and the frames
+    up to now run again with the corrected keys.
+
+    Packet, little endian:
+        'N' u8 count u32 first u16 keys[count] u32 ack u32 check_frame u64 check_hash
+    keys are this side's masks for frames first.. first+count-1, everything the
+    peer has not acked yet, so a lost packet is covered by the next one. ack is
+    how many frames of the peer's keys arrived here. check_hash is the state
+    hash at the start of check_frame, the newest frame whose inputs are final,
+    the peer compares it with its own to report desyncs. 0 means no check yet.
+
+    A side more than NETPLAY_MAX_ROLLBACK frames ahead of the remote keys stalls
+    until they arrive, and gives up when the peer has been silent for 10s.
+    delay and loss are applied to outgoing packets so the whole thing can be
+    tested over loopback, see tools/src/netplay.c.
+*/
+
+#define NETPLAY_SEED 0x43484950U
+#define NETPLAY_MAX_ROLLBACK 8U
+// Frame ring, power of two
+#define NETPLAY_WINDOW 64U
+#define NETPLAY_MAX_PACKET (6U + NETPLAY_WINDOW * 2U + 16U)
+#define NETPLAY_QUEUE_SIZE 256U
+
+typedef struct {
+    uint32_t frame;
+    // Machine at the start of the frame and its hash
+    Chip8State state;
+    uint64_t hash;
+    uint16_t local;
+    // Real remote keys once frame < remote_frames, the prediction before that
+    uint16_t remote;
+} NetplayFrame;
+
+// Outgoing packet held back by the injected delay
+typedef struct {
+    uint64_t due;
+    uint32_t length;
+    uint8_t bytes[NETPLAY_MAX_PACKET];
+} NetplayPacket;
+
+typedef struct {
+    int fd;
+    struct sockaddr_in peer;
+
+    // Local keypad, written by the front end, sampled once per frame
+    uint8_t keys[16];
+
+    NetplayFrame* frames;
+    // Next frame to run
+    uint32_t frame;
+    // Remote keys are known for every frame below this
+    uint32_t remote_frames;
+    uint16_t last_remote;
+    // The peer has our keys for every frame below this
+    uint32_t peer_ack;
+    uint64_t last_send;
+    uint64_t last_receive;
+
+    // Latest check from the peer waiting until our own state for that frame is final
+    uint32_t check_frame;
+    uint64_t check_hash;
+
+    // Injected network conditions
+    unsigned delay_ms;
+    unsigned loss_percent;
+    uint32_t random;
+    NetplayPacket* queue;
+    uint32_t queue_length;
+
+    unsigned long rollbacks;
+    unsigned long resimulated;
+    unsigned long max_rollback;
+    uint64_t max_rollback_ns;
+    unsigned long stalls;
+    unsigned long desyncs;
+} Netplay;
+
+// Bind localport and talk to host:port, see above for the format
+void OpenNetplay(Netplay* netplay, const char* address);
+
+// Delay every outgoing packet by delay_ms and drop loss_percent of them
+void SetNetplayConditions(Netplay* netplay, unsigned delay_ms, unsigned loss_percent);
+
+// Take in remote keys, rolling back if a prediction was wrong, then run the next
+// frame with cycles instructions. Returns false when stalled waiting for the peer
+bool NetplayAdvance(Netplay* netplay, Chip8* chip, uint32_t cycles);
+
+// Only take in remote keys and roll back, for draining at the end of a session
+void NetplayPoll(Netplay* netplay, Chip8* chip, uint32_t cycles);
+
+// Prints rollback and desync counts
+void CloseNetplay(Netplay* netplay);
+
+#endif
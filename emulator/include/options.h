@@ -0,0 +1,61 @@
+#ifndef CHIPPY_OPTIONS_H
+#define CHIPPY_OPTIONS_H
+
+#include <stdbool.h>
+
+/* Command line: chippy [options] <scale> <delay> <rom> */
+typedef struct {
+    int scale;
+    int delay;
+    const char* rom_path;
+
+    // Run without a window as fast as the host allows
+    bool headless;
+    // Headless runs stop after this many 60Hz frames
+    unsigned long frames;
+    // Instructions executed per 60Hz frame, from delay unless --ipf is given
+    int cycles_per_frame;
+    // Emulated frames per displayed frame
+    unsigned long speed;
+    // Start unthrottled, tab toggles it at runtime
+    bool turbo;
+    // Present every Nth emulated frame instead of the latest one per refresh, 0 for latest
+    unsigned long frameskip;
+    // Show the metrics overlay from the start, F3 toggles it
+    bool overlay;
+    // Append a line of metrics per second here, see metrics.h
+    const char* stats_path;
+    // Measure input to photon latency, reported on exit and with F8
+    bool latency;
+    // CPU filter chain for the window, see filter.h
+    const char* filter_list;
+    // Filter worker threads, 0 for one per core
+    unsigned long filter_threads;
+    // Run this many machines tiled in one window, 0 for a single machine, see mosaic.h
+    unsigned long mosaic;
+    // Write frames to this file, see capture.h for formats
+    const char* capture_path;
+    // Publish frames to viewers on this address, see stream.h
+    const char* stream_address;
+    // Draw in the terminal and read keys from stdin instead of a window, see terminal.h
+    bool terminal;
+    // Publish frames into this POSIX shared memory segment, see shared.h
+    const char* shm_name;
+    // Two player rollback session with this address, see netplay.h
+    const char* netplay_address;
+    // Injected outgoing delay and loss for testing netplay
+    unsigned long net_delay;
+    unsigned long net_loss;
+    // Start paused in the interactive debugger
+    bool debug;
+    // Watchpoint list for watch.h, runs the debug engine
+    const char* watch_list;
+    // Record every instruction into a ring written here on exit or error
+    const char* trace_path;
+    unsigned long trace_size;
+} Options;
+
+// Parse argv into options, prints usage and exits on bad input
+void ParseOptions(Options* options, int argc, char** argv);
+
+#endif
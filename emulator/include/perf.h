@@ -0,0 +1,49 @@
+#ifndef CHIPPY_PERF_H
+#define CHIPPY_PERF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Host hardware counters through Linux perf_event_open, user space only.
+
+    The counters below are opened as one group so a single read snapshots
+    all of them at the same point. Counters the host will not give us
+    (virtual machines, containers, perf_event_paranoid) are left out and
+    PerfHas says so, the rest still work.
+*/
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_COUNTERS
+} PerfCounter;
+
+typedef struct {
+    uint64_t values[PERF_COUNTERS];
+} PerfSample;
+
+typedef struct {
+    // Group leader, -1 when nothing could be opened
+    int group;
+    int fds[PERF_COUNTERS];
+    // Where each counter sits in a group read
+    uint32_t slots[PERF_COUNTERS];
+    uint32_t count;
+} Perf;
+
+// Open and start the counters, false when the host has none of them
+bool OpenPerf(Perf* perf);
+
+// Snapshot every counter, false if the group is not being counted (the PMU is taken)
+bool PerfRead(Perf const* perf, PerfSample* sample);
+
+bool PerfHas(Perf const* perf, PerfCounter counter);
+const char* PerfName(PerfCounter counter);
+
+void ClosePerf(Perf* perf);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef CHIPPY_SHARED_H
+#define CHIPPY_SHARED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "chip8.h"
+
+/*
+    Frames in POSIX shared memory for other processes, --shm=/name.
+
+    The segment is a SharedHeader followed by slot_count SharedSlots of
+    slot_size bytes each. Frame n (counting from 1) goes into slot
+    n % slot_count under a seqlock: the slot's sequence turns odd, the data
+    is written, the sequence turns even again and only then does
+    header.frame become n. A reader copies the slot of the frame it wants
+    between two reads of the sequence and keeps the copy when both are the
+    same even number and slot.frame is the frame it asked for, see
+    SharedReadFrame. The emulator never waits for readers, a reader more
+    than slot_count frames behind finds its frame overwritten.
+
+    Readers press keys by storing a mask in header.keys, bit n for key n.
+    Once per frame the emulator applies the bits that changed since it last
+    looked, the same as key events from the window or stream viewers.
+
+    All fields are native endian, the segment is only shared on one host.
+*/
+
+#define SHARED_MAGIC 0x53384843U
+#define SHARED_VERSION 1U
+#define SHARED_SLOTS 16U
+
+typedef struct {
+    _Atomic uint32_t sequence;
+    uint32_t reserved;
+    uint64_t frame;
+    uint8_t registers[16];
+    uint16_t stack[16];
+    uint16_t index;
+    uint16_t pc;
+    // Keypad the frame ran with, bit per key
+    uint16_t keypad;
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    // One byte per pixel, 1 when lit, row major CHIP8_VIDEO_WIDTH wide
+    uint8_t pixels[CHIP8_VIDEO_SIZE];
+} SharedSlot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t width;
+    uint32_t height;
+    // Newest complete frame, 0 before the first
+    _Atomic uint64_t frame;
+    // Keys held by readers, bit per key
+    _Atomic uint32_t keys;
+    uint32_t reserved;
+} SharedHeader;
+
+typedef struct {
+    char* name;
+    SharedHeader* header;
+    SharedSlot* slots;
+    size_t size;
+    // Reader keys already applied to the keypad
+    uint32_t keys;
+} SharedFrames;
+
+// Create and map the segment called name, replacing a stale one
+void OpenSharedFrames(SharedFrames* shared, const char* name);
+
+// Publish the machine as the next frame and apply reader key changes
+void SharedPublish(SharedFrames* shared, Chip8* chip);
+
+// Unmap and remove the segment
+void CloseSharedFrames(SharedFrames* shared);
+
+// Reader side, map an existing segment. Returns false if it is missing or not a chippy segment
+bool AttachSharedFrames(SharedFrames* shared, const char* name);
+
+// Copy frame out of the ring, false if it was overwritten or not published yet
+bool SharedReadFrame(SharedFrames const* shared, uint64_t frame, SharedSlot* out);
+
+void DetachSharedFrames(SharedFrames* shared);
+
+#endif
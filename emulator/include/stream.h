@@ -0,0 +1,64 @@
+#ifndef CHIPPY_STREAM_H
+#define CHIPPY_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <poll.h>
+#include "chip8.h"
+
+/*
+    Frame streaming over a local socket, "unix:/path/to.sock" or "tcp:port" (loopback only).
+
+    Server -> viewer, one message per changed 60Hz frame:
+        'F' u32 sequence u16 length, then length bytes of payload
+    The payload is the 1bpp frame xor the last frame that viewer received,
+    run length coded: 0x00 n is n zero bytes, any other byte is a literal.
+    A new viewer starts from an all zero frame so its first delta is the full frame.
+
+    Viewer -> server, two bytes per key event:
+        key (0x0-0xF) state (0 released, 1 pressed)
+
+    Sockets never block the emulator. A viewer whose send buffer is full just
+    skips frames and gets a bigger delta once it drains.
+*/
+
+#define STREAM_MAX_CLIENTS 512U
+#define STREAM_BUFFER_SIZE 4096U
+#define STREAM_MAX_MESSAGE (7U + CHIP8_VIDEO_BYTES * 2U)
+
+typedef struct {
+    int fd;
+    uint32_t sequence;
+    uint8_t frame[CHIP8_VIDEO_BYTES];
+    uint8_t out[STREAM_BUFFER_SIZE];
+    size_t out_length;
+    uint8_t in[2];
+    size_t in_length;
+} StreamClient;
+
+typedef struct {
+    int fd;
+    char* path;
+    uint32_t sequence;
+    uint8_t frame[CHIP8_VIDEO_BYTES];
+    // Delta from the previous published frame, shared by every viewer that is caught up
+    uint8_t delta[STREAM_MAX_MESSAGE];
+    size_t delta_length;
+    StreamClient* clients;
+    size_t client_count;
+    struct pollfd* pollfds;
+} StreamServer;
+
+// Listen on address, see above for the format
+void OpenStreamServer(StreamServer* server, const char* address);
+
+// Queue the current frame for every viewer if it changed since the last call
+void StreamPublish(StreamServer* server, Chip8 const* chip);
+
+// Accept viewers, apply their key events to the keypad and push queued bytes
+void StreamPoll(StreamServer* server, Chip8* chip);
+
+void CloseStreamServer(StreamServer* server);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef CHIPPY_TERMINAL_H
+#define CHIPPY_TERMINAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <termios.h>
+#include "chip8.h"
+#include "gui.h"
+
+/*
+    Play in a terminal, for sessions over ssh with no display. POSIX only.
+
+    The screen is 64x16 cells of Unicode half blocks, one cell per two pixels
+    stacked. Each frame only the cells that changed since the last one are
+    written, reached by whichever is shorter of a cursor move or rewriting
+    the cells in between, and the whole frame goes out in one write. A busy
+    frame is a few hundred bytes, an idle one nothing at all.
+
+    Keys come from stdin in raw mode with the window's layout (1234 qwer asdf
+    zxcv). Terminals only send presses, so a press holds its key for
+    TERMINAL_HOLD_MS and the keyboard's auto repeat keeps it down. Esc or
+    ctrl-c quits, tab toggles turbo and ctrl-l redraws everything.
+*/
+
+#define TERMINAL_ROWS (CHIP8_VIDEO_HEIGHT / 2U)
+#define TERMINAL_COLUMNS CHIP8_VIDEO_WIDTH
+#define TERMINAL_HOLD_MS 200U
+// Worst case frame: every cell with a cursor move in front of it
+#define TERMINAL_BUFFER_SIZE (TERMINAL_ROWS * TERMINAL_COLUMNS * 12U + 64U)
+
+typedef struct {
+    struct termios saved;
+    // Cell on screen at each position, top pixel in bit 0 and bottom in bit 1, 0xFF when unknown
+    uint8_t cells[TERMINAL_ROWS][TERMINAL_COLUMNS];
+    // Where the terminal's cursor is, parked below the screen between frames
+    uint32_t row;
+    uint32_t column;
+    // Monotonic ns at which each key lets go
+    uint64_t release[16];
+    char out[TERMINAL_BUFFER_SIZE];
+    size_t out_length;
+} Terminal;
+
+// Switch stdin to raw mode and take over the screen, restored on exit and error too
+void OpenTerminal(Terminal* terminal);
+void CloseTerminal(Terminal* terminal);
+
+// Write the cells that changed since the last frame
+void TerminalDraw(Terminal* terminal, Chip8 const* chip);
+
+// Apply pending key presses and expired holds to keys, keypad changes go to
+// latency unless NULL. Returns true on quit
+bool TerminalInput(Terminal* terminal, uint8_t* keys, Hotkeys* hotkeys, Latency* latency);
+
+#endif
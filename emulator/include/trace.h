@@ -0,0 +1,59 @@
+#ifndef CHIPPY_TRACE_H
+#define CHIPPY_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "chip8.h"
+
+/*
+    Execution trace, one packed record per instruction in a fixed size ring.
+    The ring is written to disk on exit and when error() kills the emulator,
+    tools/chippy-trace decodes it.
+
+    File layout, little endian:
+        "CH8T" u32 record size u64 instructions executed u32 records
+        then records oldest first
+*/
+
+#define TRACE_NO_REGISTER 0xFFU
+
+typedef struct {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t index;
+    // Register the instruction changed (VF only if nothing else) or TRACE_NO_REGISTER
+    uint8_t reg;
+    uint8_t value;
+} TraceRecord;
+
+typedef struct {
+    TraceRecord* records;
+    // Capacity is a power of two so wrapping is a mask
+    size_t mask;
+    uint64_t head;
+    const char* path;
+} Trace;
+
+// Ring of at least capacity records, dumped to path on CloseTrace and on error()
+void OpenTrace(Trace* trace, const char* path, size_t capacity);
+
+// Record the instruction at chip->pc, call before executing it
+static inline TraceRecord* TraceBegin(Trace* trace, Chip8 const* chip) {
+    TraceRecord* record = &trace->records[trace->head++ & trace->mask];
+    record->pc = chip->pc;
+    record->opcode = (Chip8Peek(chip, chip->pc) << 8u) | Chip8Peek(chip, chip->pc + 1);
+    record->index = chip->index;
+    record->reg = TRACE_NO_REGISTER;
+    record->value = 0;
+    return record;
+}
+
+// Fill in the register change, before holds the registers from ahead of the instruction
+void TraceEnd(TraceRecord* record, Chip8 const* chip, uint8_t const* before);
+
+// Write the ring to trace->path
+void WriteTrace(Trace const* trace);
+
+void CloseTrace(Trace* trace);
+
+#endif
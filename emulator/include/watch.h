@@ -0,0 +1,71 @@
+#ifndef CHIPPY_WATCH_H
+#define CHIPPY_WATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+
+/*
+    Memory watchpoints and self modifying code detection.
+
+    Instructions that touch guest memory (DXYN, FX33, FX55, FX65) call into here
+    only when chip->watch is set, so normal runs pay one predictable branch on
+    those instructions and nothing anywhere else. A page bitmap (256 byte pages)
+    filters accesses before the per byte bitmaps are looked at.
+
+    Code is marked as executed by the debug engine variant, any later write to
+    an executed byte is reported as self modifying code.
+*/
+
+#define WATCH_PAGE_SIZE 256U
+#define WATCH_PAGES (CHIP8_MEMORY_SIZE / WATCH_PAGE_SIZE)
+
+enum {
+    WATCH_READ = 1 << 0,
+    WATCH_WRITE = 1 << 1,
+    WATCH_SMC = 1 << 2
+};
+
+typedef struct {
+    uint16_t pc;
+    uint16_t address;
+    uint8_t value;
+    uint8_t kind;
+} WatchHit;
+
+typedef struct watch {
+    // One bit per page with anything of that kind in it
+    uint16_t read_pages;
+    uint16_t write_pages;
+    uint16_t code_pages;
+
+    // One bit per byte
+    uint64_t read[CHIP8_MEMORY_SIZE / 64];
+    uint64_t write[CHIP8_MEMORY_SIZE / 64];
+    uint64_t code[CHIP8_MEMORY_SIZE / 64];
+
+    // Most recent hit, cleared by whoever reports it
+    bool triggered;
+    WatchHit hit;
+    uint64_t smc_writes;
+} Watch;
+
+void InitWatch(Watch* watch);
+
+// Watch [start, end] for the given WATCH_READ / WATCH_WRITE kinds
+void AddWatch(Watch* watch, uint16_t start, uint16_t end, unsigned kinds);
+
+// Parse "w:200-2ff,r:300" style lists (kinds r, w or rw, addresses in hex), false on bad input
+bool ParseWatchList(Watch* watch, const char* text);
+
+// Mark the instruction at pc as executed code
+void WatchExecute(Watch* watch, uint16_t pc);
+
+// Called by the instruction handlers on guest memory accesses
+void WatchRead(Watch* watch, Chip8 const* chip, uint16_t address);
+void WatchWrite(Watch* watch, Chip8 const* chip, uint16_t address);
+
+// Print a hit as a single line
+void PrintWatchHit(WatchHit const* hit);
+
+#endif
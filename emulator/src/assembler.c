@@ -0,0 +1,397 @@
+#include "assembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#define ASSEMBLER_ORIGIN 0x200U
+#define ASSEMBLER_MAX_LINE 256U
+#define ASSEMBLER_MAX_OPERANDS 16U
+
+typedef enum {
+    OPERAND_VALUE,
+    OPERAND_REGISTER,
+    OPERAND_I,
+    OPERAND_INDIRECT,
+    OPERAND_DT,
+    OPERAND_ST,
+    OPERAND_K,
+    OPERAND_F,
+    OPERAND_B
+} OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    long value;
+} Operand;
+
+typedef struct {
+    char name[ASSEMBLER_MAX_LABEL];
+    uint16_t address;
+} Label;
+
+typedef struct {
+    Label labels[ASSEMBLER_MAX_LABELS];
+    uint32_t label_count;
+    // Pass 1 only sizes statements, unknown labels are fine until pass 2
+    int pass;
+    uint32_t line;
+    uint8_t* out;
+    size_t capacity;
+    size_t length;
+    char* message;
+    size_t message_size;
+} Assembler;
+
+static bool Fail(Assembler* assembler, const char* reason) {
+    snprintf(assembler->message, assembler->message_size, "line %u: %s", (unsigned)assembler->line, reason);
+    return false;
+}
+
+static char* Trim(char* text) {
+    while (isspace((unsigned char)*text)) {
+        ++text;
+    }
+    size_t length = strlen(text);
+    while (length && isspace((unsigned char)text[length - 1])) {
+        text[--length] = '\0';
+    }
+    return text;
+}
+
+static bool SameWord(const char* a, const char* b) {
+    for (; *a && *b; ++a, ++b) {
+        if (toupper((unsigned char)*a) != toupper((unsigned char)*b)) {
+            return false;
+        }
+    }
+    return *a == *b;
+}
+
+static bool IsIdentifier(const char* text) {
+    if (!isalpha((unsigned char)*text) && *text != '_') {
+        return false;
+    }
+    for (; *text; ++text) {
+        if (!isalnum((unsigned char)*text) && *text != '_' && *text != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static Label* FindLabel(Assembler* assembler, const char* name) {
+    for (uint32_t i = 0; i < assembler->label_count; ++i) {
+        if (strcmp(assembler->labels[i].name, name) == 0) {
+            return &assembler->labels[i];
+        }
+    }
+    return NULL;
+}
+
+// number, label, or a sum of them with + and -
+static bool ParseValue(Assembler* assembler, char* text, long* value) {
+    *value = 0;
+    long sign = 1;
+
+    for (char* term = Trim(text); *term;) {
+        if (*term == '+' || *term == '-') {
+            sign = *term == '-' ? -sign : sign;
+            term = Trim(term + 1);
+            continue;
+        }
+
+        size_t length = strcspn(term, "+-");
+        char saved = term[length];
+        term[length] = '\0';
+        char* word = Trim(term);
+
+        long number = 0;
+        if (isdigit((unsigned char)*word)) {
+            char* end = NULL;
+            number = strtol(word, &end, 0);
+            if (*end != '\0') {
+                return Fail(assembler, "bad number");
+            }
+        } else if (IsIdentifier(word)) {
+            Label* label = FindLabel(assembler, word);
+            if (!label && assembler->pass == 2) {
+                return Fail(assembler, "unknown label");
+            }
+            number = label ? label->address : 0;
+        } else {
+            return Fail(assembler, "expected a number or label");
+        }
+
+        *value += sign * number;
+        sign = 1;
+        term[length] = saved;
+        term += length;
+    }
+    return true;
+}
+
+static bool ParseOperand(Assembler* assembler, char* text, Operand* operand) {
+    text = Trim(text);
+    static const struct {
+        const char* name;
+        OperandKind kind;
+    } NAMES[] = {
+        { "I", OPERAND_I }, { "[I]", OPERAND_INDIRECT }, { "DT", OPERAND_DT }, { "ST", OPERAND_ST },
+        { "K", OPERAND_K }, { "F", OPERAND_F }, { "B", OPERAND_B }
+    };
+
+    if ((text[0] == 'V' || text[0] == 'v') && isxdigit((unsigned char)text[1]) && text[2] == '\0') {
+        operand->kind = OPERAND_REGISTER;
+        operand->value = strtol(text + 1, NULL, 16);
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); ++i) {
+        if (SameWord(text, NAMES[i].name)) {
+            operand->kind = NAMES[i].kind;
+            operand->value = 0;
+            return true;
+        }
+    }
+
+    operand->kind = OPERAND_VALUE;
+    return ParseValue(assembler, text, &operand->value);
+}
+
+static bool Emit(Assembler* assembler, uint8_t byte) {
+    if (assembler->length == assembler->capacity) {
+        return Fail(assembler, "program too big");
+    }
+    if (assembler->pass == 2) {
+        assembler->out[assembler->length] = byte;
+    }
+    assembler->length += 1;
+    return true;
+}
+
+static bool EmitWord(Assembler* assembler, long word) {
+    return Emit(assembler, (word >> 8) & 0xFF) && Emit(assembler, word & 0xFF);
+}
+
+static bool Byte(Assembler* assembler, long value, long* out) {
+    if (assembler->pass == 2 && (value < -128 || value > 0xFF)) {
+        return Fail(assembler, "byte out of range");
+    }
+    *out = value & 0xFF;
+    return true;
+}
+
+static bool Address(Assembler* assembler, long value, long* out) {
+    if (assembler->pass == 2 && (value < 0 || value > 0xFFF)) {
+        return Fail(assembler, "address out of range");
+    }
+    *out = value & 0xFFF;
+    return true;
+}
+
+// Instructions named op with exactly these operand kinds
+static bool Match(Operand const* operands, size_t count, size_t expected, OperandKind a, OperandKind b) {
+    return count == expected && (expected < 1 || operands[0].kind == a) && (expected < 2 || operands[1].kind == b);
+}
+
+static bool Encode(Assembler* assembler, const char* op, Operand const* o, size_t count) {
+    long x = count > 0 ? o[0].value : 0;
+    long y = count > 1 ? o[1].value : 0;
+    long value = 0;
+    const OperandKind R = OPERAND_REGISTER;
+    const OperandKind N = OPERAND_VALUE;
+
+    static const struct {
+        const char* name;
+        uint16_t base;
+    } ALU[] = { { "OR", 0x8001 }, { "AND", 0x8002 }, { "XOR", 0x8003 }, { "SUB", 0x8005 }, { "SUBN", 0x8007 } };
+    for (size_t i = 0; i < sizeof(ALU) / sizeof(ALU[0]); ++i) {
+        if (strcmp(op, ALU[i].name) == 0 && Match(o, count, 2, R, R)) {
+            return EmitWord(assembler, ALU[i].base | (x << 8) | (y << 4));
+        }
+    }
+
+    if (strcmp(op, "CLS") == 0 && count == 0) {
+        return EmitWord(assembler, 0x00E0);
+    } else if (strcmp(op, "RET") == 0 && count == 0) {
+        return EmitWord(assembler, 0x00EE);
+    } else if (strcmp(op, "SYS") == 0 && Match(o, count, 1, N, N)) {
+        return Address(assembler, x, &value) && EmitWord(assembler, value);
+    } else if (strcmp(op, "JP") == 0 && Match(o, count, 1, N, N)) {
+        return Address(assembler, x, &value) && EmitWord(assembler, 0x1000 | value);
+    } else if (strcmp(op, "JP") == 0 && Match(o, count, 2, R, N) && x == 0) {
+        return Address(assembler, y, &value) && EmitWord(assembler, 0xB000 | value);
+    } else if (strcmp(op, "CALL") == 0 && Match(o, count, 1, N, N)) {
+        return Address(assembler, x, &value) && EmitWord(assembler, 0x2000 | value);
+    } else if (strcmp(op, "SE") == 0 && Match(o, count, 2, R, N)) {
+        return Byte(assembler, y, &value) && EmitWord(assembler, 0x3000 | (x << 8) | value);
+    } else if (strcmp(op, "SNE") == 0 && Match(o, count, 2, R, N)) {
+        return Byte(assembler, y, &value) && EmitWord(assembler, 0x4000 | (x << 8) | value);
+    } else if (strcmp(op, "SE") == 0 && Match(o, count, 2, R, R)) {
+        return EmitWord(assembler, 0x5000 | (x << 8) | (y << 4));
+    } else if (strcmp(op, "SNE") == 0 && Match(o, count, 2, R, R)) {
+        return EmitWord(assembler, 0x9000 | (x << 8) | (y << 4));
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, R, N)) {
+        return Byte(assembler, y, &value) && EmitWord(assembler, 0x6000 | (x << 8) | value);
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, R, R)) {
+        return EmitWord(assembler, 0x8000 | (x << 8) | (y << 4));
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, OPERAND_I, N)) {
+        return Address(assembler, y, &value) && EmitWord(assembler, 0xA000 | value);
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, R, OPERAND_DT)) {
+        return EmitWord(assembler, 0xF007 | (x << 8));
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, R, OPERAND_K)) {
+        return EmitWord(assembler, 0xF00A | (x << 8));
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, OPERAND_DT, R)) {
+        return EmitWord(assembler, 0xF015 | (y << 8));
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, OPERAND_ST, R)) {
+        return EmitWord(assembler, 0xF018 | (y << 8));
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, OPERAND_F, R)) {
+        return EmitWord(assembler, 0xF029 | (y << 8));
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, OPERAND_B, R)) {
+        return EmitWord(assembler, 0xF033 | (y << 8));
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, OPERAND_INDIRECT, R)) {
+        return EmitWord(assembler, 0xF055 | (y << 8));
+    } else if (strcmp(op, "LD") == 0 && Match(o, count, 2, R, OPERAND_INDIRECT)) {
+        return EmitWord(assembler, 0xF065 | (x << 8));
+    } else if (strcmp(op, "ADD") == 0 && Match(o, count, 2, R, N)) {
+        return Byte(assembler, y, &value) && EmitWord(assembler, 0x7000 | (x << 8) | value);
+    } else if (strcmp(op, "ADD") == 0 && Match(o, count, 2, R, R)) {
+        return EmitWord(assembler, 0x8004 | (x << 8) | (y << 4));
+    } else if (strcmp(op, "ADD") == 0 && Match(o, count, 2, OPERAND_I, R)) {
+        return EmitWord(assembler, 0xF01E | (y << 8));
+    } else if ((strcmp(op, "SHR") == 0 || strcmp(op, "SHL") == 0) && (Match(o, count, 1, R, R) || Match(o, count, 2, R, R))) {
+        return EmitWord(assembler, (op[2] == 'R' ? 0x8006 : 0x800E) | (x << 8) | (y << 4));
+    } else if (strcmp(op, "RND") == 0 && Match(o, count, 2, R, N)) {
+        return Byte(assembler, y, &value) && EmitWord(assembler, 0xC000 | (x << 8) | value);
+    } else if (strcmp(op, "DRW") == 0 && count == 3 && o[0].kind == R && o[1].kind == R && o[2].kind == N) {
+        if (assembler->pass == 2 && (o[2].value < 0 || o[2].value > 15)) {
+            return Fail(assembler, "sprite height out of range");
+        }
+        return EmitWord(assembler, 0xD000 | (x << 8) | (y << 4) | (o[2].value & 0xF));
+    } else if (strcmp(op, "SKP") == 0 && Match(o, count, 1, R, R)) {
+        return EmitWord(assembler, 0xE09E | (x << 8));
+    } else if (strcmp(op, "SKNP") == 0 && Match(o, count, 1, R, R)) {
+        return EmitWord(assembler, 0xE0A1 | (x << 8));
+    } else if (strcmp(op, "DW") == 0 && Match(o, count, 1, N, N)) {
+        if (assembler->pass == 2 && (x < 0 || x > 0xFFFF)) {
+            return Fail(assembler, "word out of range");
+        }
+        return EmitWord(assembler, x);
+    } else if (strcmp(op, "DB") == 0 && count > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            if (o[i].kind != N) {
+                return Fail(assembler, "DB takes numbers");
+            }
+            if (!Byte(assembler, o[i].value, &value) || !Emit(assembler, value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    return Fail(assembler, "unknown instruction or operands");
+}
+
+static bool AssembleLine(Assembler* assembler, char* line) {
+    char* comment = strchr(line, ';');
+    if (comment) {
+        *comment = '\0';
+    }
+    char* text = Trim(line);
+
+    // Leading label
+    char* colon = strchr(text, ':');
+    if (colon) {
+        *colon = '\0';
+        char* name = Trim(text);
+        if (!IsIdentifier(name) || strlen(name) >= ASSEMBLER_MAX_LABEL) {
+            return Fail(assembler, "bad label");
+        }
+        if (assembler->pass == 1) {
+            if (FindLabel(assembler, name)) {
+                return Fail(assembler, "label defined twice");
+            }
+            if (assembler->label_count == ASSEMBLER_MAX_LABELS) {
+                return Fail(assembler, "too many labels");
+            }
+            Label* label = &assembler->labels[assembler->label_count++];
+            strcpy(label->name, name);
+            label->address = ASSEMBLER_ORIGIN + assembler->length;
+        }
+        text = Trim(colon + 1);
+    }
+    if (*text == '\0') {
+        return true;
+    }
+
+    // Mnemonic, then comma separated operands
+    char op[8];
+    size_t op_length = strcspn(text, " \t");
+    if (op_length >= sizeof(op)) {
+        return Fail(assembler, "unknown instruction or operands");
+    }
+    for (size_t i = 0; i < op_length; ++i) {
+        op[i] = toupper((unsigned char)text[i]);
+    }
+    op[op_length] = '\0';
+
+    Operand operands[ASSEMBLER_MAX_OPERANDS];
+    size_t count = 0;
+    char* rest = Trim(text + op_length);
+    while (*rest) {
+        if (count == ASSEMBLER_MAX_OPERANDS) {
+            return Fail(assembler, "too many operands");
+        }
+        size_t length = strcspn(rest, ",");
+        bool last = rest[length] == '\0';
+        rest[length] = '\0';
+        if (!ParseOperand(assembler, rest, &operands[count++])) {
+            return false;
+        }
+        rest = last ? rest + length : rest + length + 1;
+    }
+
+    return Encode(assembler, op, operands, count);
+}
+
+bool Assemble(const char* source, uint8_t* out, size_t capacity, size_t* length, char* message, size_t message_size) {
+    assert(source && out && length);
+    Assembler* assembler = calloc(1, sizeof(Assembler));
+    if (!assembler) {
+        snprintf(message, message_size, "out of memory");
+        return false;
+    }
+    assembler->out = out;
+    assembler->capacity = capacity;
+    assembler->message = message;
+    assembler->message_size = message_size;
+
+    bool ok = true;
+    for (int pass = 1; ok && pass <= 2; ++pass) {
+        assembler->pass = pass;
+        assembler->line = 0;
+        assembler->length = 0;
+
+        for (const char* start = source; ok && *start;) {
+            size_t line_length = strcspn(start, "\n");
+            char line[ASSEMBLER_MAX_LINE];
+            assembler->line += 1;
+            if (line_length >= sizeof(line)) {
+                ok = Fail(assembler, "line too long");
+                break;
+            }
+            memcpy(line, start, line_length);
+            line[line_length] = '\0';
+            ok = AssembleLine(assembler, line);
+
+            start += line_length;
+            start += *start == '\n';
+        }
+    }
+
+    *length = assembler->length;
+    free(assembler);
+    return ok;
+}
@@ -0,0 +1,294 @@
+#include "capture.h"
+#include "error.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+enum {
+    GIF_MIN_CODE_SIZE = 2,
+    GIF_CLEAR_CODE = 1 << GIF_MIN_CODE_SIZE,
+    GIF_END_CODE = GIF_CLEAR_CODE + 1,
+    GIF_MAX_CODES = 4096,
+    GIF_BLOCK_SIZE = 255
+};
+
+static void WriteU16(FILE* file, uint16_t value) {
+    fputc(value & 0xFFu, file);
+    fputc((value >> 8u) & 0xFFu, file);
+}
+
+static void WriteU32(FILE* file, uint32_t value) {
+    WriteU16(file, value & 0xFFFFu);
+    WriteU16(file, (value >> 16u) & 0xFFFFu);
+}
+
+// Expand the packed frame into one byte per output pixel, 0 off and 1 on
+static void ExpandFrame(Capture* capture) {
+    for (int y = 0; y < capture->height; ++y) {
+        int sy = y / capture->scale;
+        for (int x = 0; x < capture->width; ++x) {
+            int sx = x / capture->scale;
+            int bit = sy * CHIP8_VIDEO_WIDTH + sx;
+            capture->pixels[y * capture->width + x] = (capture->frame[bit / 8] >> (7 - (bit % 8))) & 0x1u;
+        }
+    }
+}
+
+// Bit packer for the gif lzw stream, codes go lsb first into 255 byte sub blocks
+typedef struct {
+    FILE* file;
+    uint32_t bits;
+    int count;
+    uint8_t block[GIF_BLOCK_SIZE];
+    int length;
+} GifWriter;
+
+static void GifFlushBlock(GifWriter* writer) {
+    if (writer->length > 0) {
+        fputc(writer->length, writer->file);
+        fwrite(writer->block, 1, writer->length, writer->file);
+        writer->length = 0;
+    }
+}
+
+static void GifPutCode(GifWriter* writer, uint16_t code, int size) {
+    writer->bits |= (uint32_t)code << writer->count;
+    writer->count += size;
+
+    while (writer->count >= 8) {
+        writer->block[writer->length++] = writer->bits & 0xFFu;
+        writer->bits >>= 8u;
+        writer->count -= 8;
+
+        if (writer->length == GIF_BLOCK_SIZE) {
+            GifFlushBlock(writer);
+        }
+    }
+}
+
+// Plain lzw with a trie of (prefix code, pixel) -> code, reset once all 4096 codes are used
+static void GifWriteImage(Capture* capture) {
+    GifWriter writer = { .file = capture->file };
+    size_t count = (size_t)capture->width * capture->height;
+    uint16_t (*children)[GIF_CLEAR_CODE] = (uint16_t (*)[GIF_CLEAR_CODE])capture->lzw;
+
+    int size = GIF_MIN_CODE_SIZE + 1;
+    uint16_t next = GIF_END_CODE + 1;
+    memset(capture->lzw, 0, sizeof(uint16_t) * GIF_MAX_CODES * GIF_CLEAR_CODE);
+
+    fputc(GIF_MIN_CODE_SIZE, capture->file);
+    GifPutCode(&writer, GIF_CLEAR_CODE, size);
+
+    uint16_t prefix = capture->pixels[0];
+    for (size_t i = 1; i < count; ++i) {
+        uint8_t pixel = capture->pixels[i];
+
+        if (children[prefix][pixel]) {
+            prefix = children[prefix][pixel];
+            continue;
+        }
+
+        GifPutCode(&writer, prefix, size);
+
+        if (next < GIF_MAX_CODES) {
+            if (next == (1 << size)) {
+                size += 1;
+            }
+            children[prefix][pixel] = next++;
+        } else {
+            GifPutCode(&writer, GIF_CLEAR_CODE, size);
+            memset(capture->lzw, 0, sizeof(uint16_t) * GIF_MAX_CODES * GIF_CLEAR_CODE);
+            size = GIF_MIN_CODE_SIZE + 1;
+            next = GIF_END_CODE + 1;
+        }
+
+        prefix = pixel;
+    }
+
+    GifPutCode(&writer, prefix, size);
+    GifPutCode(&writer, GIF_END_CODE, size);
+
+    if (writer.count > 0) {
+        GifPutCode(&writer, 0, 8 - writer.count);
+    }
+    GifFlushBlock(&writer);
+
+    // Block terminator
+    fputc(0, capture->file);
+}
+
+static void GifWriteFrame(Capture* capture, uint16_t delay) {
+    // Graphic control extension, no transparency
+    fputc(0x21, capture->file);
+    fputc(0xF9, capture->file);
+    fputc(0x04, capture->file);
+    fputc(0x00, capture->file);
+    WriteU16(capture->file, delay);
+    fputc(0x00, capture->file);
+    fputc(0x00, capture->file);
+
+    // Image descriptor covering the whole screen
+    fputc(0x2C, capture->file);
+    WriteU16(capture->file, 0);
+    WriteU16(capture->file, 0);
+    WriteU16(capture->file, capture->width);
+    WriteU16(capture->file, capture->height);
+    fputc(0x00, capture->file);
+
+    GifWriteImage(capture);
+}
+
+static void WriteHeader(Capture* capture) {
+    switch (capture->format) {
+        case CAPTURE_RAW:
+            fwrite("CH8R", 1, 4, capture->file);
+            WriteU16(capture->file, CHIP8_VIDEO_WIDTH);
+            WriteU16(capture->file, CHIP8_VIDEO_HEIGHT);
+            break;
+        case CAPTURE_Y4M:
+            fprintf(capture->file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", capture->width, capture->height);
+            break;
+        case CAPTURE_GIF: {
+            // Global colour table with two entries, black then white
+            static const uint8_t palette[6] = { 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF };
+            fwrite("GIF89a", 1, 6, capture->file);
+            WriteU16(capture->file, capture->width);
+            WriteU16(capture->file, capture->height);
+            fputc(0x80, capture->file);
+            fputc(0x00, capture->file);
+            fputc(0x00, capture->file);
+            fwrite(palette, 1, sizeof(palette), capture->file);
+
+            // Loop forever
+            fputc(0x21, capture->file);
+            fputc(0xFF, capture->file);
+            fputc(0x0B, capture->file);
+            fwrite("NETSCAPE2.0", 1, 11, capture->file);
+            fputc(0x03, capture->file);
+            fputc(0x01, capture->file);
+            WriteU16(capture->file, 0);
+            fputc(0x00, capture->file);
+        } break;
+    }
+}
+
+// Write the pending frame together with how many 60Hz frames it was on screen
+static void FlushFrame(Capture* capture) {
+    if (capture->repeat == 0) {
+        return;
+    }
+
+    capture->ticks += capture->repeat;
+
+    switch (capture->format) {
+        case CAPTURE_RAW:
+            WriteU32(capture->file, capture->repeat);
+            fwrite(capture->frame, 1, CHIP8_VIDEO_BYTES, capture->file);
+            break;
+        case CAPTURE_Y4M: {
+            size_t luma = (size_t)capture->width * capture->height;
+            ExpandFrame(capture);
+            for (size_t i = 0; i < luma; ++i) {
+                capture->pixels[i] = capture->pixels[i] ? 0xFF : 0x00;
+            }
+            // Neutral chroma, two quarter size planes
+            memset(capture->pixels + luma, 0x80, luma / 2);
+
+            // Y4M has no frame durations, a held frame goes out once per 60Hz frame
+            for (uint32_t i = 0; i < capture->repeat; ++i) {
+                fputs("FRAME\n", capture->file);
+                fwrite(capture->pixels, 1, luma + luma / 2, capture->file);
+            }
+        } break;
+        case CAPTURE_GIF: {
+            // Gif delays are in 1/100s, round against the running total so 60Hz does not drift
+            uint64_t end = (capture->ticks * 100 + 30) / 60;
+            uint64_t delay = end - capture->centiseconds;
+            capture->centiseconds = end;
+
+            ExpandFrame(capture);
+            while (delay > UINT16_MAX) {
+                GifWriteFrame(capture, UINT16_MAX);
+                delay -= UINT16_MAX;
+            }
+            GifWriteFrame(capture, (uint16_t)delay);
+        } break;
+    }
+
+    capture->repeat = 0;
+}
+
+void OpenCapture(Capture* capture, const char* path, int scale) {
+    assert(capture);
+    memset(capture, 0, sizeof(Capture));
+
+    const char* extension = strrchr(path, '.');
+    if (!extension) {
+        error("Capture file needs a .raw, .y4m or .gif extension");
+    } else if (strcmp(extension, ".raw") == 0) {
+        capture->format = CAPTURE_RAW;
+    } else if (strcmp(extension, ".y4m") == 0) {
+        capture->format = CAPTURE_Y4M;
+    } else if (strcmp(extension, ".gif") == 0) {
+        capture->format = CAPTURE_GIF;
+    } else {
+        error("Capture file needs a .raw, .y4m or .gif extension");
+    }
+
+    capture->scale = scale > 0 ? scale : 1;
+    capture->width = CHIP8_VIDEO_WIDTH * capture->scale;
+    capture->height = CHIP8_VIDEO_HEIGHT * capture->scale;
+
+    capture->file = fopen(path, "wb");
+    if (!capture->file) {
+        error("Could not open capture file");
+    }
+
+    // Room for the y4m chroma planes after the pixels
+    capture->pixels = malloc((size_t)capture->width * capture->height * 3 / 2);
+    if (!capture->pixels) {
+        error("Could not allocate capture buffer");
+    }
+
+    if (capture->format == CAPTURE_GIF) {
+        capture->lzw = malloc(sizeof(uint16_t) * GIF_MAX_CODES * GIF_CLEAR_CODE);
+        if (!capture->lzw) {
+            error("Could not allocate gif encoder");
+        }
+    }
+
+    WriteHeader(capture);
+}
+
+void CaptureFrame(Capture* capture, Chip8 const* chip) {
+    assert(capture);
+    uint8_t frame[CHIP8_VIDEO_BYTES];
+    Chip8PackVideo(chip, frame);
+
+    if (capture->repeat > 0 && memcmp(frame, capture->frame, CHIP8_VIDEO_BYTES) == 0) {
+        capture->repeat += 1;
+        return;
+    }
+
+    FlushFrame(capture);
+    memcpy(capture->frame, frame, CHIP8_VIDEO_BYTES);
+    capture->repeat = 1;
+}
+
+void CloseCapture(Capture* capture) {
+    assert(capture);
+    if (!capture->file) {
+        return;
+    }
+
+    FlushFrame(capture);
+    if (capture->format == CAPTURE_GIF) {
+        fputc(0x3B, capture->file);
+    }
+
+    fclose(capture->file);
+    free(capture->pixels);
+    free(capture->lzw);
+    memset(capture, 0, sizeof(Capture));
+}
@@ -1,17 +1,22 @@
 #include "chip8.h"
 #include "error.h"
+#include "watch.h"
 
 #include <string.h>
+#include <stddef.h>
 #include <time.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 static const uint16_t START_ADDRESS = 0x200U;
-static const unsigned int FONTSET_START_ADDRESS = 0x50;
+enum { FONTSET_START_ADDRESS = 0x50 };
 
-enum { FONTSET_SIZE = 80 };
-static uint8_t fontset[FONTSET_SIZE] =
+// Page 0 before a rom is loaded, the font and nothing else
+static const uint8_t FONT_PAGE[CHIP8_PAGE_SIZE] =
 {
+	[FONTSET_START_ADDRESS] =
 	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
 	0x20, 0x60, 0x20, 0x20, 0x70, // 1
 	0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
@@ -30,29 +35,334 @@ static uint8_t fontset[FONTSET_SIZE] =
 	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-static uint8_t RandomByte() {
-    return rand() % UINT8_MAX;
+/*
+    State hash
+
+    The state is viewed as a list of (position, byte) pairs and the hash is the
+    xor of a key for each pair, zero bytes contribute nothing. Positions:
+        0x0000 memory, 0x1000 registers, 0x1010 stack (lo, hi), 0x1030 index,
+        0x1032 pc, 0x1034 sp, 0x1035 timers, 0x1037 rng, 0x2000 pixels
+
+    Built with CHIPPY_STATE_HASH every write below goes through a setter that
+    xors the old byte's key out and the new one in, so Chip8HashState is a
+    field read. Pixels keep their own part so CLS can reset it in O(1).
+    Without it the setters are plain stores and Chip8HashState walks the state.
+*/
+
+enum {
+    HASH_MEMORY = 0x0000,
+    HASH_REGISTERS = 0x1000,
+    HASH_STACK = 0x1010,
+    HASH_INDEX = 0x1030,
+    HASH_PC = 0x1032,
+    HASH_SP = 0x1034,
+    HASH_DELAY = 0x1035,
+    HASH_SOUND = 0x1036,
+    HASH_RNG = 0x1037,
+    HASH_VIDEO = 0x2000
+};
+
+// splitmix64 finaliser over position and value
+static inline uint64_t HashKey(uint32_t position, uint8_t value) {
+    if (value == 0) {
+        return 0;
+    }
+
+    uint64_t x = ((uint64_t)position << 8u) | value;
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30u)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27u)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31u);
+}
+
+static uint64_t HashBytes(uint32_t position, uint8_t const* bytes, size_t count) {
+    uint64_t hash = 0;
+    for (size_t i = 0; i < count; ++i) {
+        hash ^= HashKey(position + i, bytes[i]);
+    }
+    return hash;
+}
+
+static uint64_t HashU16(uint32_t position, uint16_t value) {
+    return HashKey(position, value & 0xFFu) ^ HashKey(position + 1, value >> 8u);
+}
+
+#if defined(CHIPPY_STATE_HASH)
+#define HASH_BYTE(chip, position, before, after) ((chip)->hash ^= HashKey(position, before) ^ HashKey(position, after))
+#define HASH_U16(chip, position, before, after) ((chip)->hash ^= HashU16(position, before) ^ HashU16(position, after))
+#define HASH_PIXEL(chip, pixel) ((chip)->video_hash ^= HashKey(HASH_VIDEO + (pixel), 1))
+#define HASH_CLEAR_VIDEO(chip) ((chip)->video_hash = 0)
+#else
+#define HASH_BYTE(chip, position, before, after) ((void)0)
+#define HASH_U16(chip, position, before, after) ((void)0)
+#define HASH_PIXEL(chip, pixel) ((void)0)
+#define HASH_CLEAR_VIDEO(chip) ((void)0)
+#endif
+
+// Everything but the pixels
+static uint64_t HashMachine(Chip8 const* chip) {
+    uint64_t hash = HashBytes(HASH_REGISTERS, chip->registers, 16);
+    for (uint32_t page = 0; page < CHIP8_PAGE_COUNT; ++page) {
+        hash ^= HashBytes(HASH_MEMORY + page * CHIP8_PAGE_SIZE, chip->pages[page], CHIP8_PAGE_SIZE);
+    }
+
+    for (uint32_t i = 0; i < 16; ++i) {
+        hash ^= HashU16(HASH_STACK + i * 2, chip->stack[i]);
+    }
+
+    hash ^= HashU16(HASH_INDEX, chip->index);
+    hash ^= HashU16(HASH_PC, chip->pc);
+    hash ^= HashKey(HASH_SP, chip->sp);
+    hash ^= HashKey(HASH_DELAY, chip->delay_timer);
+    hash ^= HashKey(HASH_SOUND, chip->sound_timer);
+    hash ^= HashU16(HASH_RNG, chip->rng & 0xFFFFu);
+    hash ^= HashU16(HASH_RNG + 2, chip->rng >> 16u);
+    return hash;
+}
+
+static uint64_t HashVideo(Chip8 const* chip) {
+    uint64_t hash = 0;
+    for (uint32_t i = 0; i < CHIP8_VIDEO_SIZE; ++i) {
+        hash ^= HashKey(HASH_VIDEO + i, chip->video[i] & 0x1u);
+    }
+    return hash;
+}
+
+// Start tracking again after the state was replaced wholesale
+static void Rehash(Chip8* chip) {
+#if defined(CHIPPY_STATE_HASH)
+    chip->hash = HashMachine(chip);
+    chip->video_hash = HashVideo(chip);
+#else
+    (void)chip;
+#endif
+}
+
+static inline void SetRegister(Chip8* chip, uint8_t reg, uint8_t value) {
+    HASH_BYTE(chip, HASH_REGISTERS + reg, chip->registers[reg], value);
+    chip->registers[reg] = value;
+}
+
+static inline void SetIndex(Chip8* chip, uint16_t value) {
+    HASH_U16(chip, HASH_INDEX, chip->index, value);
+    chip->index = value;
+}
+
+static inline void SetPc(Chip8* chip, uint16_t value) {
+    HASH_U16(chip, HASH_PC, chip->pc, value);
+    chip->pc = value;
+}
+
+static inline void Push(Chip8* chip, uint16_t value) {
+    HASH_U16(chip, HASH_STACK + chip->sp * 2, chip->stack[chip->sp], value);
+    chip->stack[chip->sp] = value;
+    HASH_BYTE(chip, HASH_SP, chip->sp, chip->sp + 1);
+    chip->sp += 1;
+}
+
+static inline uint16_t Pop(Chip8* chip) {
+    HASH_BYTE(chip, HASH_SP, chip->sp, chip->sp - 1);
+    chip->sp -= 1;
+    return chip->stack[chip->sp];
+}
+
+static inline void SetDelayTimer(Chip8* chip, uint8_t value) {
+    HASH_BYTE(chip, HASH_DELAY, chip->delay_timer, value);
+    chip->delay_timer = value;
+}
+
+static inline void SetSoundTimer(Chip8* chip, uint8_t value) {
+    HASH_BYTE(chip, HASH_SOUND, chip->sound_timer, value);
+    chip->sound_timer = value;
+}
+
+static inline void SetRng(Chip8* chip, uint32_t value) {
+    HASH_U16(chip, HASH_RNG, chip->rng & 0xFFFFu, value & 0xFFFFu);
+    HASH_U16(chip, HASH_RNG + 2, chip->rng >> 16u, value >> 16u);
+    chip->rng = value;
+}
+
+// xorshift32, top byte since the low bits are the weakest
+static uint8_t RandomByte(Chip8* chip) {
+    uint32_t x = chip->rng;
+    x ^= x << 13u;
+    x ^= x >> 17u;
+    x ^= x << 5u;
+    SetRng(chip, x);
+    return x >> 24u;
+}
+
+
+// What pages show before anything is loaded, zero is also FUSE_UNKNOWN for their fusion
+static const uint8_t BLANK_PAGE[CHIP8_PAGE_SIZE];
+
+/*
+    Private pages come from one pool shared by every machine in the process,
+    so a machine costs its registers, its screen and the pages it wrote.
+    The pool grows in blocks and keeps pages handed back by Chip8Release for
+    the next machine. Daemon workers write from several threads at once, a
+    spinlock guards the free list.
+*/
+
+struct chip8_page {
+    uint8_t memory[CHIP8_PAGE_SIZE];
+    uint8_t fusion[CHIP8_PAGE_SIZE];
+    struct chip8_page* next;
+};
+
+enum { PAGE_BLOCK = 64 };
+
+static struct chip8_page* free_pages = NULL;
+static atomic_flag pool_lock = ATOMIC_FLAG_INIT;
+
+static void LockPool(void) {
+    while (atomic_flag_test_and_set_explicit(&pool_lock, memory_order_acquire)) {
+    }
+}
+
+static void UnlockPool(void) {
+    atomic_flag_clear_explicit(&pool_lock, memory_order_release);
+}
+
+static struct chip8_page* TakePage(void) {
+    LockPool();
+    if (!free_pages) {
+        struct chip8_page* block = malloc(sizeof(struct chip8_page) * PAGE_BLOCK);
+        if (!block) {
+            // The daemon's handler does not return
+            UnlockPool();
+            error("Could not allocate memory pages");
+        }
+        for (size_t i = 0; i < PAGE_BLOCK; ++i) {
+            block[i].next = free_pages;
+            free_pages = &block[i];
+        }
+    }
+    struct chip8_page* page = free_pages;
+    free_pages = page->next;
+    UnlockPool();
+    return page;
+}
+
+static void GivePage(struct chip8_page* page) {
+    LockPool();
+    page->next = free_pages;
+    free_pages = page;
+    UnlockPool();
+}
+
+// What the machine started from, the image or the blank pages
+static uint8_t const* BasePage(Chip8 const* chip, uint16_t page) {
+    if (chip->image) {
+        return &chip->image->memory[page * CHIP8_PAGE_SIZE];
+    }
+    return page == 0 ? FONT_PAGE : BLANK_PAGE;
+}
+
+static void SharePage(Chip8* chip, uint16_t page) {
+    if (chip->private_pages[page]) {
+        GivePage(chip->private_pages[page]);
+        chip->private_pages[page] = NULL;
+    }
+    chip->pages[page] = BasePage(chip, page);
+    chip->fusion[page] = chip->image ? &chip->image->fusion[page * CHIP8_PAGE_SIZE] : BLANK_PAGE;
 }
 
+// First write to a page gives the machine its own copy
+static inline struct chip8_page* OwnPage(Chip8* chip, uint16_t page) {
+    struct chip8_page* own = chip->private_pages[page];
+    if (!own) {
+        own = TakePage();
+        memcpy(own->memory, chip->pages[page], CHIP8_PAGE_SIZE);
+        memcpy(own->fusion, chip->fusion[page], CHIP8_PAGE_SIZE);
+        chip->private_pages[page] = own;
+        chip->pages[page] = own->memory;
+        chip->fusion[page] = own->fusion;
+    }
+    return own;
+}
+
+// Whole pages are forgotten by the fusion cache, the bytes are new code
+static void CopyIn(Chip8* chip, uint16_t address, uint8_t const* bytes, size_t count) {
+    while (count) {
+        uint16_t offset = address % CHIP8_PAGE_SIZE;
+        size_t length = CHIP8_PAGE_SIZE - offset < count ? CHIP8_PAGE_SIZE - offset : count;
+        struct chip8_page* own = OwnPage(chip, address / CHIP8_PAGE_SIZE);
+        memcpy(own->memory + offset, bytes, length);
+        memset(own->fusion, 0, CHIP8_PAGE_SIZE);
+        address += length;
+        bytes += length;
+        count -= length;
+    }
+}
+
+static uint8_t Analyze(uint8_t const* page, uint16_t pc);
 
 void Chip8Init(Chip8* chip) {
     memset(chip, 0, sizeof(Chip8));
     chip->pc = START_ADDRESS;
-
-    // Load fonts into memory
-    for (size_t i = 0; i < FONTSET_SIZE; i++) {
-        chip->memory[FONTSET_START_ADDRESS + i] = fontset[i];
+    for (uint16_t page = 0; page < CHIP8_PAGE_COUNT; ++page) {
+        SharePage(chip, page);
     }
-    
+
     // Seed random nums
-    srand(time(NULL));
+    Chip8Seed(chip, (uint32_t)time(NULL));
+}
+
+void Chip8Release(Chip8* chip) {
+    for (uint16_t page = 0; page < CHIP8_PAGE_COUNT; ++page) {
+        if (chip->private_pages[page]) {
+            SharePage(chip, page);
+        }
+    }
+}
+
+void Chip8Seed(Chip8* chip, uint32_t seed) {
+    // xorshift gets stuck on zero
+    chip->rng = seed ? seed : 0x2545F491u;
+    Rehash(chip);
 }
 
 void Chip8LoadRom(Chip8* chip, Rom* rom) {
     if (rom->rom_size > (CHIP8_MEMORY_SIZE - START_ADDRESS)) {
         error("[ERRPR] ROM is too big");
     }
-    memcpy(&chip->memory[START_ADDRESS], rom->memory, rom->rom_size);
+    CopyIn(chip, START_ADDRESS, rom->memory, rom->rom_size);
+    Rehash(chip);
+}
+
+Chip8Image* Chip8CreateImage(Rom const* rom) {
+    if (rom->rom_size > (CHIP8_MEMORY_SIZE - START_ADDRESS)) {
+        error("ROM is too big");
+    }
+    Chip8Image* image = calloc(1, sizeof(Chip8Image));
+    if (!image) {
+        error("Could not allocate rom image");
+    }
+    memcpy(image->memory, FONT_PAGE, CHIP8_PAGE_SIZE);
+    memcpy(&image->memory[START_ADDRESS], rom->memory, rom->rom_size);
+
+    // Every machine on the image reads these until it writes the page
+    for (uint16_t address = 0; address < CHIP8_MEMORY_SIZE; ++address) {
+        uint16_t base = address - address % CHIP8_PAGE_SIZE;
+        image->fusion[address] = Analyze(&image->memory[base], address);
+    }
+    return image;
+}
+
+void Chip8DestroyImage(Chip8Image** image) {
+    if (*image) {
+        free(*image);
+        *image = NULL;
+    }
+}
+
+void Chip8LoadImage(Chip8* chip, Chip8Image const* image) {
+    chip->image = image;
+    for (uint16_t page = 0; page < CHIP8_PAGE_COUNT; ++page) {
+        SharePage(chip, page);
+    }
+    Rehash(chip);
 }
 
 // Static opcode handlers below
@@ -98,32 +408,57 @@ void Chip8LoadRom(Chip8* chip, Rom* rom) {
         $Fx65
 */
 
+// Guest memory accesses made by instructions, addresses wrap at 4K like the index register would
+static inline uint8_t ReadMemory(Chip8* chip, uint16_t address) {
+    address &= CHIP8_MEMORY_SIZE - 1;
+    if (chip->watch) {
+        WatchRead(chip->watch, chip, address);
+    }
+    return chip->pages[address / CHIP8_PAGE_SIZE][address % CHIP8_PAGE_SIZE];
+}
+
+static inline void WriteMemory(Chip8* chip, uint16_t address, uint8_t value) {
+    address &= CHIP8_MEMORY_SIZE - 1;
+    struct chip8_page* page = OwnPage(chip, address / CHIP8_PAGE_SIZE);
+    uint16_t offset = address % CHIP8_PAGE_SIZE;
+    HASH_BYTE(chip, HASH_MEMORY + address, page->memory[offset], value);
+    page->memory[offset] = value;
+
+    // Forget fused sequences (up to 6 bytes) that include this byte, none leave their page
+    for (uint16_t i = 0; i < 6 && i <= offset; ++i) {
+        page->fusion[offset - i] = 0;
+    }
+
+    if (chip->watch) {
+        WatchWrite(chip->watch, chip, address);
+    }
+}
+
 #define INSTRUCTION(instruction) static void OP_##instruction (Chip8* chip)
 
 // Clear the display (CLS)
 static void OP_00E0(Chip8* chip) {
     // Its an array so size of is total bytes
     memset(chip->video, 0, sizeof(chip->video));
+    HASH_CLEAR_VIDEO(chip);
 }
 
 // Return on stack
 static void OP_00EE(Chip8* chip) {
-    chip->sp -= 1;
-    chip->pc = chip->stack[chip->sp];
+    SetPc(chip, Pop(chip));
 }
 
 // Jp to location nnn
 static void OP_1NNN(Chip8* chip, uint16_t opcode) {
     uint16_t address = opcode & 0x0FFFu;
-    chip->pc = address;
+    SetPc(chip, address);
 }
 
 // Call subroutine at nnn
 static void OP_2NNN(Chip8* chip, uint16_t opcode) {
     uint16_t address = opcode & 0x0FFFu;
-    chip->stack[chip->sp] = chip->pc;
-    chip->sp += 1;
-    chip->pc = address;
+    Push(chip, chip->pc);
+    SetPc(chip, address);
 }
 
 // Skip next instruction if Vx=kk
@@ -133,7 +468,7 @@ static void OP_3XKK(Chip8* chip, uint16_t opcode) {
 
     // Skip the pc ahead
     if (chip->registers[vx] == byte) {
-        chip->pc += 2;
+        SetPc(chip, chip->pc + 2);
     }
 }
 
@@ -143,7 +478,7 @@ static void OP_4XKK(Chip8* chip, uint16_t opcode) {
     uint8_t byte = opcode & 0x00FFu;
 
     if (chip->registers[vx] != byte) {
-        chip->pc += 2;
+        SetPc(chip, chip->pc + 2);
     }
 }
 
@@ -153,7 +488,7 @@ static void OP_5XY0(Chip8* chip, uint16_t opcode) {
     uint8_t vy = (opcode & 0x00F0u) >> 4u;
 
     if (chip->registers[vx] == chip->registers[vy]) {
-        chip->pc += 2;
+        SetPc(chip, chip->pc + 2);
     }
 }
 
@@ -162,7 +497,7 @@ static void OP_6XKK(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
     uint8_t byte = (opcode & 0x00FFu);
 
-    chip->registers[vx] = byte;
+    SetRegister(chip, vx, byte);
 }
 
 // Set vx = vx + kk
@@ -170,7 +505,7 @@ static void OP_7XKK(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
     uint8_t byte = (opcode & 0x00FFu);
 
-    chip->registers[vx] += byte;
+    SetRegister(chip, vx, chip->registers[vx] + byte);
 }
 
 // Set vx = vy
@@ -178,7 +513,7 @@ static void OP_8XY0(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
 	uint8_t vy = (opcode & 0x00F0u) >> 4u;
 
-    chip->registers[vx] = chip->registers[vy];
+    SetRegister(chip, vx, chip->registers[vy]);
 }
 
 // Set vx = vx or vy
@@ -186,7 +521,7 @@ static void OP_8XY1(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
 	uint8_t vy = (opcode & 0x00F0u) >> 4u;
 
-    chip->registers[vx] |= chip->registers[vy];
+    SetRegister(chip, vx, chip->registers[vx] | chip->registers[vy]);
 }
 
 // Set vx = vx and vy
@@ -194,7 +529,7 @@ static void OP_8XY2(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
 	uint8_t vy = (opcode & 0x00F0u) >> 4u;
 
-    chip->registers[vx] &= chip->registers[vy];
+    SetRegister(chip, vx, chip->registers[vx] & chip->registers[vy]);
 }
 
 // Set vx = vx xor vy
@@ -202,7 +537,7 @@ static void OP_8XY3(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
 	uint8_t vy = (opcode & 0x00F0u) >> 4u;
 
-    chip->registers[vx] ^= chip->registers[vy];
+    SetRegister(chip, vx, chip->registers[vx] ^ chip->registers[vy]);
 }
 
 // Set Vx = Vx + Vy, set VF = carry
@@ -213,12 +548,12 @@ static void OP_8XY4(Chip8* chip, uint16_t opcode) {
 
     // Set VF
     if (sum > UINT8_MAX) {
-        chip->registers[0xF] = 1;
+        SetRegister(chip, 0xF, 1);
     } else {
-        chip->registers[0xF] = 0;
+        SetRegister(chip, 0xF, 0);
     }
 
-    chip->registers[vx] = sum & 0xFFu;
+    SetRegister(chip, vx, sum & 0xFFu);
 }
 
 // Set Vx = Vx - Vy, set VF = NOT borrow
@@ -228,19 +563,19 @@ static void OP_8XY5(Chip8* chip, uint16_t opcode) {
 
     // Set VF to not borrow
     if (chip->registers[vx] > chip->registers[vy]) {
-        chip->registers[0xF] = 1;
+        SetRegister(chip, 0xF, 1);
     } else {
-        chip->registers[0xF] = 0;
+        SetRegister(chip, 0xF, 0);
     }
 
-    chip->registers[vx] -= chip->registers[vy];
+    SetRegister(chip, vx, chip->registers[vx] - chip->registers[vy]);
 }
 
 // Set vx = vx shr 1
 static void OP_8XY6(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    chip->registers[0xF] = (chip->registers[vx] & 0x1u);
-    chip->registers[vx] >>= 1;
+    SetRegister(chip, 0xF, chip->registers[vx] & 0x1u);
+    SetRegister(chip, vx, chip->registers[vx] >> 1u);
 }
 
 // Set Vx = Vy - Vx, set VF = NOT borrow
@@ -250,12 +585,13 @@ static void OP_8XY7(Chip8* chip, uint16_t opcode) {
 
     // Set VF to not borrow
     if (chip->registers[vy] > chip->registers[vx]) {
-        chip->registers[0xF] = 1;
+        SetRegister(chip, 0xF, 1);
     } else {
-        chip->registers[0xF] = 0;
+        SetRegister(chip, 0xF, 0);
     }
 
-    chip->registers[vx] = chip->registers[vy] = chip->registers[vx];
+    SetRegister(chip, vy, chip->registers[vx]);
+    SetRegister(chip, vx, chip->registers[vy]);
 }
 
 // Set vx = vx shl 1
@@ -263,8 +599,8 @@ static void OP_8XYE(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
 
     // Save MSB in 0xF
-    chip->registers[0xF] = (chip->registers[vx] & 0x80u) >> 7u;
-    chip->registers[vx] <<= 1;
+    SetRegister(chip, 0xF, (chip->registers[vx] & 0x80u) >> 7u);
+    SetRegister(chip, vx, chip->registers[vx] << 1u);
 }
 
 // Skip next instruction if Vx != Vy
@@ -273,27 +609,27 @@ static void OP_9XY0(Chip8* chip, uint16_t opcode) {
 	uint8_t vy = (opcode & 0x00F0u) >> 4u;
 
     if (chip->registers[vx] != chip->registers[vy]) {
-        chip->pc += 2;
+        SetPc(chip, chip->pc + 2);
     }
 }
 
 // Annn - LD I, addr
 static void OP_ANNN(Chip8* chip, uint16_t opcode) {
     uint16_t address = opcode & 0x0FFFu;
-    chip->index = address;
+    SetIndex(chip, address);
 }
 
 // Jump to location nnn + V0
 static void OP_BNNN(Chip8* chip, uint16_t opcode) {
     uint16_t address = opcode & 0x0FFFu;
-    chip->pc = chip->registers[0x0] + address;
+    SetPc(chip, chip->registers[0x0] + address);
 }
 
 // Set Vx = random byte AND kk
 static void OP_CXKK(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
     uint8_t byte = (opcode & 0x00FFu);
-    chip->registers[vx] = RandomByte() & byte;
+    SetRegister(chip, vx, RandomByte(chip) & byte);
 }
 
 // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision
@@ -305,13 +641,15 @@ static void OP_DXYN(Chip8* chip, uint16_t opcode) {
     uint8_t xpos = chip->registers[vx] % CHIP8_VIDEO_WIDTH;
     uint8_t ypos = chip->registers[vy] % CHIP8_VIDEO_HEIGHT;
 
-    chip->registers[0xF] = 0;
+    SetRegister(chip, 0xF, 0);
 
-    for (size_t row = 0; row < height; ++row) {
-        uint8_t sbyte = chip->memory[chip->index + row];
-        for (size_t col = 0; col < 8; ++col) {
+    // Only the start wraps, rows past the bottom and columns past the right edge are clipped
+    for (size_t row = 0; row < height && ypos + row < CHIP8_VIDEO_HEIGHT; ++row) {
+        uint8_t sbyte = ReadMemory(chip, chip->index + row);
+        for (size_t col = 0; col < 8 && xpos + col < CHIP8_VIDEO_WIDTH; ++col) {
             uint8_t spixel = sbyte & (0x80u >> col);
-            uint32_t* screenpixel = &chip->video[(ypos + row) * CHIP8_VIDEO_WIDTH + (xpos + col)];
+            size_t pixel = (ypos + row) * CHIP8_VIDEO_WIDTH + xpos + col;
+            uint32_t* screenpixel = &chip->video[pixel];
 
             // When we want a sprite pixel we need to check if the screen already is on and if it is,
             // xor it and since we are using uint32_t for the display 0x00000000 is off, 0xFFFFFFFF is on
@@ -321,11 +659,12 @@ static void OP_DXYN(Chip8* chip, uint16_t opcode) {
 				// Screen pixel also on - collision
 				if (*screenpixel == 0xFFFFFFFF)
 				{
-					chip->registers[0xF] = 1;
+					SetRegister(chip, 0xF, 1);
 				}
 
 				// Effectively XOR with the sprite pixel
 				*screenpixel ^= 0xFFFFFFFF;
+				HASH_PIXEL(chip, pixel);
 			}
         }
     }
@@ -335,9 +674,10 @@ static void OP_DXYN(Chip8* chip, uint16_t opcode) {
 static void OP_EX9E(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
     uint8_t key = chip->registers[vx];
+    chip->keys_read |= 1u << (key & 0xFu);
 
     if (chip->keypad[key]) {
-        chip->pc += 2;
+        SetPc(chip, chip->pc + 2);
     }
 }
 
@@ -345,133 +685,135 @@ static void OP_EX9E(Chip8* chip, uint16_t opcode) {
 static void OP_EXA1(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
     uint8_t key = chip->registers[vx];
+    chip->keys_read |= 1u << (key & 0xFu);
 
     if (!chip->keypad[key]) {
-        chip->pc += 2;
+        SetPc(chip, chip->pc + 2);
     }
 }
 
 // Set Vx = delay timer value
 static void OP_FX07(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    chip->registers[vx] = chip->delay_timer;
+    SetRegister(chip, vx, chip->delay_timer);
 }
 
 // Wait for a key press, store the value of the key in Vx
 static void OP_FX0A(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
+    chip->keys_read = 0xFFFFu;
 
     if (chip->keypad[0])
 	{
-		chip->registers[vx] = 0;
+		SetRegister(chip, vx, 0);
 	}
 	else if (chip->keypad[1])
 	{
-		chip->registers[vx] = 1;
+		SetRegister(chip, vx, 1);
 	}
 	else if (chip->keypad[2])
 	{
-		chip->registers[vx] = 2;
+		SetRegister(chip, vx, 2);
 	}
 	else if (chip->keypad[3])
 	{
-		chip->registers[vx] = 3;
+		SetRegister(chip, vx, 3);
 	}
 	else if (chip->keypad[4])
 	{
-		chip->registers[vx] = 4;
+		SetRegister(chip, vx, 4);
 	}
 	else if (chip->keypad[5])
 	{
-		chip->registers[vx] = 5;
+		SetRegister(chip, vx, 5);
 	}
 	else if (chip->keypad[6])
 	{
-		chip->registers[vx]= 6;
+		SetRegister(chip, vx, 6);
 	}
 	else if (chip->keypad[7])
 	{
-		chip->registers[vx] = 7;
+		SetRegister(chip, vx, 7);
 	}
 	else if (chip->keypad[8])
 	{
-		chip->registers[vx] = 8;
+		SetRegister(chip, vx, 8);
 	}
 	else if (chip->keypad[9])
 	{
-		chip->registers[vx] = 9;
+		SetRegister(chip, vx, 9);
 	}
 	else if (chip->keypad[10])
 	{
-		chip->registers[vx] = 10;
+		SetRegister(chip, vx, 10);
 	}
 	else if (chip->keypad[11])
 	{
-		chip->registers[vx] = 11;
+		SetRegister(chip, vx, 11);
 	}
 	else if (chip->keypad[12])
 	{
-		chip->registers[vx] = 12;
+		SetRegister(chip, vx, 12);
 	}
 	else if (chip->keypad[13])
 	{
-		chip->registers[vx] = 13;
+		SetRegister(chip, vx, 13);
 	}
 	else if (chip->keypad[14])
 	{
-		chip->registers[vx] = 14;
+		SetRegister(chip, vx, 14);
 	}
 	else if (chip->keypad[15])
 	{
-		chip->registers[vx] = 15;
+		SetRegister(chip, vx, 15);
 	}
 	else
 	{
-		chip->pc -= 2;
+		SetPc(chip, chip->pc - 2);
 	}
 }
 
 // Set delay timer = Vx
 static void OP_FX15(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    chip->delay_timer = chip->registers[vx];
+    SetDelayTimer(chip, chip->registers[vx]);
 }
 
 // Set sound timer = Vx
 static void OP_FX18(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    chip->sound_timer = chip->registers[vx];
+    SetSoundTimer(chip, chip->registers[vx]);
 }
 
 // Set I = I + Vx
 static void OP_FX1E(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    chip->index += chip->registers[vx];
+    SetIndex(chip, chip->index + chip->registers[vx]);
 }
 
 // Set I = location of sprite for digit Vx
 static void OP_FX29(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
     uint8_t digit = chip->registers[vx];
-    chip->index = FONTSET_START_ADDRESS + (5 * digit);
+    SetIndex(chip, FONTSET_START_ADDRESS + (5 * digit));
 }
 
 // Store BCD representation of Vx in memory locations I, I+1, and I+2
 static void OP_FX33(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
     uint8_t value = chip->registers[vx];
-    chip->memory[chip->index + 2] = value % 10;
+    WriteMemory(chip, chip->index + 2, value % 10);
     value /= 10;
-    chip->memory[chip->index + 1] = value % 10;
+    WriteMemory(chip, chip->index + 1, value % 10);
     value /= 10;
-    chip->memory[chip->index] = value % 10;
+    WriteMemory(chip, chip->index, value % 10);
 }
 
 // Store registers V0 through Vx in memory starting at location I
 static void OP_FX55(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
     for(uint8_t i = 0; i <= vx; ++i) {
-        chip->memory[chip->index + i] = chip->registers[i];
+        WriteMemory(chip, chip->index + i, chip->registers[i]);
     }
 }
 
@@ -479,22 +821,16 @@ static void OP_FX55(Chip8* chip, uint16_t opcode) {
 static void OP_FX65(Chip8* chip, uint16_t opcode) {
     uint8_t vx = (opcode & 0x0F00u) >> 8u;
     for(uint8_t i = 0; i <= vx; ++i) {
-        chip->registers[i] = chip->memory[chip->index + i];
+        SetRegister(chip, i, ReadMemory(chip, chip->index + i));
     }
 }
 
 
-void Chip8Cycle(Chip8* chip) {
+// Decode and run one opcode, the pc has already been moved past it
+static void Execute(Chip8* chip, uint16_t opcode) {
     // Since im a lazy bitch and dont want to make a pointer table a case switch works hehe
-    
-    // Should be ROM start
-    // Because endian problems ):
-    uint16_t opcode = (chip->memory[chip->pc] << 8u) | chip->memory[chip->pc + 1];
     uint16_t expression = (opcode & 0xF000u) >> 12u;
 
-    // Inc PC before executing
-    chip->pc += 2;
-
     char buffer[500];
    
 
@@ -639,20 +975,295 @@ void Chip8Cycle(Chip8* chip) {
             error(buffer);
             break;
     }
+}
 
+void Chip8TickTimers(Chip8* chip) {
     // Decrement delay timer if its on
     if (chip->delay_timer > 0) {
-        chip->delay_timer -= 1;
+        SetDelayTimer(chip, chip->delay_timer - 1);
     }
 
     // Decrement sound timer if its on
     if (chip->sound_timer > 0) {
-        chip->sound_timer -= 1;
+        SetSoundTimer(chip, chip->sound_timer - 1);
+    }
+}
+
+static inline uint16_t Fetch(Chip8 const* chip, uint16_t address) {
+    address &= CHIP8_MEMORY_SIZE - 1;
+    uint8_t const* page = chip->pages[address / CHIP8_PAGE_SIZE];
+    uint16_t offset = address % CHIP8_PAGE_SIZE;
+
+    // Only an odd pc at the end of a page straddles two
+    if (offset != CHIP8_PAGE_SIZE - 1) {
+        return (page[offset] << 8u) | page[offset + 1];
     }
+    return (page[offset] << 8u) | Chip8Peek(chip, address + 1);
 }
 
+void Chip8Cycle(Chip8* chip) {
+    // Should be ROM start
+    // Because endian problems ):
+    uint16_t opcode = Fetch(chip, chip->pc);
+
+    // Inc PC before executing
+    SetPc(chip, chip->pc + 2);
+
+    Execute(chip, opcode);
+}
+
+/*
+    Superinstructions
+
+    Chip8Run looks at the code under the pc once, remembers in the page's
+    fusion bytes whether it starts one of the sequences below and then runs
+    the whole sequence in one dispatch:
+        6XKK 6YKK            two loads
+        ANNN DXYN            point I at a sprite and draw it
+        7XKK 3XKK/4XKK 1NNN  counting loop tail, iterated in place when
+                             the jump goes back to the 7XKK
+        FX07 3X00 1NNN       spin until the delay timer runs out
+        1NNN                 jump to itself, the usual end of program halt,
+                             told from the opcode alone
+    Fused handlers keep the exact per instruction semantics so Chip8Run and
+    repeated Chip8Cycle calls end in the same state. Timers only move between
+    frames, which lets the timer wait and the halt finish in O(1). Only
+    opcodes that can start a sequence look at the fusion bytes, the rest
+    run exactly as Chip8Cycle would.
+
+    A sequence never crosses a page. Images analyse their pages up front and
+    machines share that until they write a page, writes through WriteMemory
+    forget any fusion that covers the written byte so self modifying code is
+    picked up. The debug engine single steps with Chip8Cycle and never fuses,
+    breakpoints and watchpoints stay exact. The frontends also stay on
+    Chip8Cycle for now, at the default 10 instructions a frame a loop pass
+    cut short by the budget costs more than it saves.
+*/
+
+enum {
+    FUSE_UNKNOWN = 0,
+    FUSE_NONE,
+    FUSE_LOAD_LOAD,
+    FUSE_INDEX_DRAW,
+    FUSE_COUNT_LOOP,
+    FUSE_TIMER_WAIT
+};
 
+// Longest fused sequence in instructions
+enum { FUSE_MAX_LENGTH = 3 };
 
+// Bit per high nibble that starts a sequence above
+enum { FUSE_STARTS = (1u << 0x6u) | (1u << 0x7u) | (1u << 0xAu) | (1u << 0xFu) };
 
+// Test on the opcode alone, so most instructions never look at the fusion bytes
+static inline bool MayFuse(uint16_t opcode) {
+    return (FUSE_STARTS >> (opcode >> 12u)) & 0x1u && ((opcode & 0xF000u) != 0xF000u || (opcode & 0x00FFu) == 0x07u);
+}
+
+// Sequences stay inside their page so a write only ever touches fusion in its own
+static uint8_t Analyze(uint8_t const* page, uint16_t pc) {
+    uint16_t offset = pc % CHIP8_PAGE_SIZE;
+    uint16_t words[FUSE_MAX_LENGTH] = { 0 };
 
+    // Past the end of the page reads as 0000, which no sequence matches
+    for (uint16_t i = 0; i < FUSE_MAX_LENGTH && offset + i * 2u + 1u < CHIP8_PAGE_SIZE; ++i) {
+        words[i] = (page[offset + i * 2] << 8u) | page[offset + i * 2 + 1];
+    }
+    uint16_t first = words[0];
+    uint16_t second = words[1];
+    uint16_t third = words[2];
+    uint16_t x = first & 0x0F00u;
+
+    switch (first & 0xF000u) {
+        case 0x6000u:
+            if ((second & 0xF000u) == 0x6000u) {
+                return FUSE_LOAD_LOAD;
+            }
+            break;
+        case 0xA000u:
+            if ((second & 0xF000u) == 0xD000u) {
+                return FUSE_INDEX_DRAW;
+            }
+            break;
+        case 0x7000u:
+            if (((second & 0xF000u) == 0x3000u || (second & 0xF000u) == 0x4000u) && (second & 0x0F00u) == x &&
+                (third & 0xF000u) == 0x1000u) {
+                return FUSE_COUNT_LOOP;
+            }
+            break;
+        case 0xF000u:
+            if ((first & 0x00FFu) == 0x07u && second == (0x3000u | x) && third == (0x1000u | pc)) {
+                return FUSE_TIMER_WAIT;
+            }
+            break;
+        default:
+            break;
+    }
+    return FUSE_NONE;
+}
+
+static uint32_t RunCountLoop(Chip8* chip, uint16_t pc, uint32_t budget) {
+    uint16_t add = Fetch(chip, pc);
+    uint16_t test = Fetch(chip, pc + 2);
+    uint16_t jump = Fetch(chip, pc + 4) & 0x0FFFu;
+    uint8_t vx = (add & 0x0F00u) >> 8u;
+    uint8_t step = add & 0x00FFu;
+    uint8_t target = test & 0x00FFu;
+    bool exit_when_equal = (test & 0xF000u) == 0x3000u;
+    uint32_t executed = 0;
+
+    // Each pass is add, test and either the skip out (2) or the jump (3)
+    while (budget - executed >= 3) {
+        SetRegister(chip, vx, chip->registers[vx] + step);
+
+        if ((chip->registers[vx] == target) == exit_when_equal) {
+            SetPc(chip, pc + 6);
+            return executed + 2;
+        }
+
+        executed += 3;
+        if (jump != pc) {
+            // The tail of a longer loop, one pass and back to its body
+            SetPc(chip, jump);
+            return executed;
+        }
+    }
+
+    SetPc(chip, pc);
+    return executed;
+}
+
+// The timer cannot change inside a frame, so either we leave now or spin out the budget
+static uint32_t RunTimerWait(Chip8* chip, uint16_t pc, uint32_t budget) {
+    SetRegister(chip, (Fetch(chip, pc) & 0x0F00u) >> 8u, chip->delay_timer);
+
+    if (chip->delay_timer == 0) {
+        SetPc(chip, pc + 6);
+        return 2;
+    }
+
+    SetPc(chip, pc);
+    return budget - budget % 3;
+}
+
+uint32_t Chip8Run(Chip8* chip, uint32_t budget) {
+    uint32_t executed = 0;
+
+    while (executed < budget) {
+        uint16_t pc = chip->pc & (CHIP8_MEMORY_SIZE - 1);
+        uint16_t opcode = Fetch(chip, pc);
+
+        if (opcode == (0x1000u | pc)) {
+            // Jump to itself, nothing changes, burn the whole budget at once
+            SetPc(chip, pc);
+            executed = budget;
+            continue;
+        }
+
+        if (MayFuse(opcode) && budget - executed >= FUSE_MAX_LENGTH) {
+            uint16_t page = pc / CHIP8_PAGE_SIZE;
+            uint8_t kind = chip->fusion[page][pc % CHIP8_PAGE_SIZE];
+
+            if (kind == FUSE_UNKNOWN) {
+                // Image pages come analysed, only the machine's own pages cache it
+                kind = Analyze(chip->pages[page], pc);
+                if (chip->private_pages[page]) {
+                    chip->private_pages[page]->fusion[pc % CHIP8_PAGE_SIZE] = kind;
+                }
+            }
+
+            switch (kind) {
+                case FUSE_LOAD_LOAD:
+                    SetPc(chip, pc + 4);
+                    OP_6XKK(chip, opcode);
+                    OP_6XKK(chip, Fetch(chip, pc + 2));
+                    executed += 2;
+                    continue;
+                case FUSE_INDEX_DRAW:
+                    SetPc(chip, pc + 4);
+                    OP_ANNN(chip, opcode);
+                    OP_DXYN(chip, Fetch(chip, pc + 2));
+                    executed += 2;
+                    continue;
+                case FUSE_COUNT_LOOP:
+                    executed += RunCountLoop(chip, pc, budget - executed);
+                    continue;
+                case FUSE_TIMER_WAIT:
+                    executed += RunTimerWait(chip, pc, budget - executed);
+                    continue;
+                default:
+                    break;
+            }
+        }
+
+        SetPc(chip, chip->pc + 2);
+        Execute(chip, opcode);
+        executed += 1;
+    }
+
+    return executed;
+}
+
+void Chip8PackVideo(Chip8 const* chip, uint8_t* out) {
+    for (size_t i = 0; i < CHIP8_VIDEO_BYTES; ++i) {
+        uint32_t const* pixels = &chip->video[i * 8];
+        uint8_t byte = 0;
+        for (size_t bit = 0; bit < 8; ++bit) {
+            byte = (byte << 1u) | (pixels[bit] & 0x1u);
+        }
+        out[i] = byte;
+    }
+}
+
+void Chip8SaveState(Chip8 const* chip, Chip8State* state) {
+    memcpy(state->registers, chip->registers, sizeof(state->registers));
+    for (size_t page = 0; page < CHIP8_PAGE_COUNT; ++page) {
+        memcpy(&state->memory[page * CHIP8_PAGE_SIZE], chip->pages[page], CHIP8_PAGE_SIZE);
+    }
+    memcpy(state->stack, chip->stack, sizeof(state->stack));
+    state->index = chip->index;
+    state->pc = chip->pc;
+    state->sp = chip->sp;
+    state->delay_timer = chip->delay_timer;
+    state->sound_timer = chip->sound_timer;
+    memcpy(state->keypad, chip->keypad, sizeof(state->keypad));
+    state->rng = chip->rng;
+    Chip8PackVideo(chip, state->video);
+}
+
+void Chip8LoadState(Chip8* chip, Chip8State const* state) {
+    memcpy(chip->registers, state->registers, sizeof(state->registers));
+    for (uint16_t page = 0; page < CHIP8_PAGE_COUNT; ++page) {
+        uint8_t const* saved = &state->memory[page * CHIP8_PAGE_SIZE];
+
+        // Memory changed under the fusion cache, CopyIn forgets it and shared pages bring their own
+        if (memcmp(saved, BasePage(chip, page), CHIP8_PAGE_SIZE) == 0) {
+            SharePage(chip, page);
+        } else {
+            CopyIn(chip, page * CHIP8_PAGE_SIZE, saved, CHIP8_PAGE_SIZE);
+        }
+    }
+    memcpy(chip->stack, state->stack, sizeof(state->stack));
+    chip->index = state->index;
+    chip->pc = state->pc;
+    chip->sp = state->sp;
+    chip->delay_timer = state->delay_timer;
+    chip->sound_timer = state->sound_timer;
+    memcpy(chip->keypad, state->keypad, sizeof(state->keypad));
+    chip->rng = state->rng;
+
+    for (size_t i = 0; i < CHIP8_VIDEO_SIZE; ++i) {
+        chip->video[i] = ((state->video[i / 8] >> (7 - (i % 8))) & 0x1u) ? 0xFFFFFFFF : 0;
+    }
+
+    Rehash(chip);
+}
+
+uint64_t Chip8HashState(Chip8 const* chip) {
+#if defined(CHIPPY_STATE_HASH)
+    return chip->hash ^ chip->video_hash;
+#else
+    return HashMachine(chip) ^ HashVideo(chip);
+#endif
+}
 
@@ -0,0 +1,342 @@
+#include "debugger.h"
+#include "disassembler.h"
+#include "watch.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <assert.h>
+
+static volatile sig_atomic_t interrupted = 0;
+
+// Ctrl-C drops into the prompt instead of killing the emulator
+static void OnInterrupt(int signum) {
+    (void)signum;
+    interrupted = 1;
+}
+
+static bool TestBit(uint64_t const* bitmap, uint16_t address) {
+    return (bitmap[address / 64] >> (address % 64)) & 0x1u;
+}
+
+static void SetBit(uint64_t* bitmap, uint16_t address) {
+    bitmap[address / 64] |= (uint64_t)1 << (address % 64);
+}
+
+static void ClearBit(uint64_t* bitmap, uint16_t address) {
+    bitmap[address / 64] &= ~((uint64_t)1 << (address % 64));
+}
+
+static uint16_t Fetch(Chip8 const* chip, uint16_t address) {
+    return (Chip8Peek(chip, address) << 8u) | Chip8Peek(chip, address + 1);
+}
+
+static bool ConditionHolds(BreakCondition const* condition, Chip8 const* chip) {
+    uint8_t value = chip->registers[condition->reg];
+
+    switch (condition->op) {
+        case CONDITION_EQ: return value == condition->value;
+        case CONDITION_NE: return value != condition->value;
+        case CONDITION_LT: return value < condition->value;
+        case CONDITION_GT: return value > condition->value;
+        case CONDITION_LE: return value <= condition->value;
+        case CONDITION_GE: return value >= condition->value;
+    }
+    return false;
+}
+
+// The pc is not masked until the next fetch, BNNN and a fetch at 0xFFE take it past 0xFFF
+static uint16_t Pc(Chip8 const* chip) {
+    return chip->pc & (CHIP8_MEMORY_SIZE - 1);
+}
+
+static bool ShouldBreak(Debugger const* debugger, Chip8 const* chip) {
+    uint16_t pc = Pc(chip);
+    if (!TestBit(debugger->breakpoints, pc)) {
+        return false;
+    }
+    if (TestBit(debugger->unconditional, pc)) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < debugger->condition_count; ++i) {
+        BreakCondition const* condition = &debugger->conditions[i];
+        if (condition->address == pc && ConditionHolds(condition, chip)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* OP_NAMES[] = { "==", "!=", "<", ">", "<=", ">=" };
+
+static bool ParseOp(const char* text, ConditionOp* op) {
+    for (size_t i = 0; i < sizeof(OP_NAMES) / sizeof(OP_NAMES[0]); ++i) {
+        if (strcmp(text, OP_NAMES[i]) == 0) {
+            *op = (ConditionOp)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void PrintLocation(Chip8 const* chip) {
+    char text[32];
+    uint16_t opcode = Fetch(chip, chip->pc);
+    Disassemble(opcode, text, sizeof(text));
+    printf("0x%03X: %04X  %s\n", chip->pc, opcode, text);
+}
+
+static void PrintRegisters(Chip8 const* chip) {
+    for (int i = 0; i < 16; ++i) {
+        printf("V%X=%02X%s", i, chip->registers[i], (i % 8 == 7) ? "\n" : " ");
+    }
+    printf("I=%03X PC=%03X SP=%X DT=%02X ST=%02X\n", chip->index, chip->pc, chip->sp, chip->delay_timer, chip->sound_timer);
+
+    printf("stack:");
+    for (int i = 0; i < chip->sp && i < 16; ++i) {
+        printf(" %03X", chip->stack[i]);
+    }
+    printf("\n");
+}
+
+static void PrintMemory(Chip8 const* chip, unsigned address, unsigned length) {
+    for (unsigned i = 0; i < length; ++i) {
+        if (i % 16 == 0) {
+            printf("%s0x%03X:", i ? "\n" : "", (address + i) % CHIP8_MEMORY_SIZE);
+        }
+        printf(" %02X", Chip8Peek(chip, address + i));
+    }
+    printf("\n");
+}
+
+static void PrintBreakpoints(Debugger const* debugger) {
+    for (uint16_t address = 0; address < CHIP8_MEMORY_SIZE; ++address) {
+        if (TestBit(debugger->unconditional, address)) {
+            printf("0x%03X\n", address);
+        }
+    }
+
+    for (uint32_t i = 0; i < debugger->condition_count; ++i) {
+        BreakCondition const* condition = &debugger->conditions[i];
+        printf("0x%03X if V%X %s %02X\n", condition->address, condition->reg, OP_NAMES[condition->op], condition->value);
+    }
+}
+
+static void AddBreakpoint(Debugger* debugger, const char* args) {
+    unsigned address = 0;
+    unsigned reg = 0;
+    unsigned value = 0;
+    char op[3] = { 0 };
+
+    int count = sscanf(args, "%x v%x %2s %x", &address, &reg, op, &value);
+    if (count < 1 || address >= CHIP8_MEMORY_SIZE) {
+        printf("usage: b <addr> [vX <op> <value>]\n");
+        return;
+    }
+
+    if (count == 1) {
+        SetBit(debugger->breakpoints, address);
+        SetBit(debugger->unconditional, address);
+        return;
+    }
+
+    BreakCondition condition = { .address = address, .reg = reg & 0xFu, .value = value & 0xFFu };
+    if (count != 4 || reg > 0xF || !ParseOp(op, &condition.op)) {
+        printf("usage: b <addr> [vX <op> <value>]\n");
+        return;
+    }
+    if (debugger->condition_count == DEBUGGER_MAX_CONDITIONS) {
+        printf("too many conditional breakpoints\n");
+        return;
+    }
+
+    debugger->conditions[debugger->condition_count++] = condition;
+    SetBit(debugger->breakpoints, address);
+}
+
+static void DeleteBreakpoint(Debugger* debugger, const char* args) {
+    unsigned address = 0;
+    if (sscanf(args, "%x", &address) != 1 || address >= CHIP8_MEMORY_SIZE) {
+        printf("usage: d <addr>\n");
+        return;
+    }
+
+    ClearBit(debugger->breakpoints, address);
+    ClearBit(debugger->unconditional, address);
+
+    for (uint32_t i = 0; i < debugger->condition_count;) {
+        if (debugger->conditions[i].address == address) {
+            debugger->conditions[i] = debugger->conditions[--debugger->condition_count];
+        } else {
+            ++i;
+        }
+    }
+}
+
+static void AddWatchpoint(Chip8 const* chip, const char* args) {
+    char kinds[3] = { 0 };
+    unsigned start = 0;
+    unsigned end = 0;
+    unsigned mask = 0;
+
+    int count = sscanf(args, "%2s %x %x", kinds, &start, &end);
+    if (count == 2) {
+        end = start;
+    }
+
+    for (size_t i = 0; i < sizeof(kinds) && kinds[i]; ++i) {
+        mask |= kinds[i] == 'r' ? WATCH_READ : kinds[i] == 'w' ? WATCH_WRITE : 0;
+    }
+
+    if (!chip->watch || count < 2 || mask == 0 || start > end || end >= CHIP8_MEMORY_SIZE) {
+        printf("usage: w <r|w|rw> <addr> [end]\n");
+        return;
+    }
+    AddWatch(chip->watch, start, end, mask);
+}
+
+// Read commands until one of them resumes execution
+static void Prompt(Debugger* debugger, Chip8 const* chip) {
+    char line[128];
+    PrintLocation(chip);
+
+    for (;;) {
+        printf("(chippy) ");
+        fflush(stdout);
+
+        if (!fgets(line, sizeof(line), stdin)) {
+            debugger->quit = true;
+            return;
+        }
+
+        char* args = line + 1;
+        switch (line[0]) {
+            case 'b':
+                AddBreakpoint(debugger, args);
+                break;
+            case 'd':
+                DeleteBreakpoint(debugger, args);
+                break;
+            case 'l':
+                PrintBreakpoints(debugger);
+                break;
+            case 's': {
+                int count = atoi(args);
+                debugger->mode = DEBUGGER_STEP;
+                debugger->steps = count > 1 ? count - 1 : 0;
+            } return;
+            case 'n':
+                // Step over a call by running until we are back right after it at the same depth
+                if ((Fetch(chip, chip->pc) & 0xF000u) == 0x2000u) {
+                    debugger->mode = DEBUGGER_NEXT;
+                    debugger->next_address = (Pc(chip) + 2) & (CHIP8_MEMORY_SIZE - 1);
+                    debugger->next_sp = chip->sp;
+                } else {
+                    debugger->mode = DEBUGGER_STEP;
+                    debugger->steps = 0;
+                }
+                return;
+            case 'c':
+                debugger->mode = DEBUGGER_RUN;
+                return;
+            case 'r':
+                PrintRegisters(chip);
+                break;
+            case 'm': {
+                unsigned address = 0;
+                unsigned length = 16;
+                if (sscanf(args, "%x %u", &address, &length) < 1) {
+                    printf("usage: m <addr> [len]\n");
+                } else {
+                    PrintMemory(chip, address, length);
+                }
+            } break;
+            case 'w':
+                AddWatchpoint(chip, args);
+                break;
+            case 'q':
+                debugger->quit = true;
+                return;
+            case '\n':
+                break;
+            default:
+                printf("commands: b d l s n c r m w q\n");
+                break;
+        }
+    }
+}
+
+void InitDebugger(Debugger* debugger, bool interactive) {
+    assert(debugger);
+    memset(debugger, 0, sizeof(Debugger));
+    debugger->interactive = interactive;
+    debugger->mode = interactive ? DEBUGGER_STEP : DEBUGGER_RUN;
+
+    if (interactive) {
+        signal(SIGINT, OnInterrupt);
+    }
+}
+
+bool DebuggerCycle(Debugger* debugger, Chip8* chip) {
+    bool stop = false;
+
+    switch (debugger->mode) {
+        case DEBUGGER_RUN:
+            break;
+        case DEBUGGER_STEP:
+            if (debugger->steps == 0) {
+                stop = true;
+            } else {
+                debugger->steps -= 1;
+            }
+            break;
+        case DEBUGGER_NEXT:
+            stop = Pc(chip) == debugger->next_address && chip->sp == debugger->next_sp;
+            break;
+    }
+
+    if (interrupted) {
+        interrupted = 0;
+        stop = true;
+    }
+
+    if (debugger->interactive && (stop || ShouldBreak(debugger, chip))) {
+        Prompt(debugger, chip);
+    }
+
+    if (debugger->quit) {
+        return false;
+    }
+
+    Watch* watch = chip->watch;
+    if (watch) {
+        WatchExecute(watch, chip->pc);
+    }
+
+    TraceRecord* record = NULL;
+    uint8_t before[16];
+    if (debugger->trace) {
+        memcpy(before, chip->registers, sizeof(before));
+        record = TraceBegin(debugger->trace, chip);
+    }
+
+    Chip8Cycle(chip);
+
+    if (record) {
+        TraceEnd(record, chip, before);
+    }
+
+    // Report after the instruction and stop before the next one
+    if (watch && watch->triggered) {
+        watch->triggered = false;
+        PrintWatchHit(&watch->hit);
+
+        if (debugger->interactive) {
+            debugger->mode = DEBUGGER_STEP;
+            debugger->steps = 0;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#include "disassembler.h"
+
+#include <stdio.h>
+
+void Disassemble(uint16_t opcode, char* out, size_t size) {
+    unsigned x = (opcode & 0x0F00u) >> 8u;
+    unsigned y = (opcode & 0x00F0u) >> 4u;
+    unsigned n = opcode & 0x000Fu;
+    unsigned kk = opcode & 0x00FFu;
+    unsigned nnn = opcode & 0x0FFFu;
+
+    switch ((opcode & 0xF000u) >> 12u) {
+        case 0x0:
+            if (opcode == 0x00E0) {
+                snprintf(out, size, "CLS");
+            } else if (opcode == 0x00EE) {
+                snprintf(out, size, "RET");
+            } else {
+                snprintf(out, size, "SYS 0x%03X", nnn);
+            }
+            return;
+        case 0x1: snprintf(out, size, "JP 0x%03X", nnn); return;
+        case 0x2: snprintf(out, size, "CALL 0x%03X", nnn); return;
+        case 0x3: snprintf(out, size, "SE V%X, 0x%02X", x, kk); return;
+        case 0x4: snprintf(out, size, "SNE V%X, 0x%02X", x, kk); return;
+        case 0x5: snprintf(out, size, "SE V%X, V%X", x, y); return;
+        case 0x6: snprintf(out, size, "LD V%X, 0x%02X", x, kk); return;
+        case 0x7: snprintf(out, size, "ADD V%X, 0x%02X", x, kk); return;
+        case 0x8:
+            switch (n) {
+                case 0x0: snprintf(out, size, "LD V%X, V%X", x, y); return;
+                case 0x1: snprintf(out, size, "OR V%X, V%X", x, y); return;
+                case 0x2: snprintf(out, size, "AND V%X, V%X", x, y); return;
+                case 0x3: snprintf(out, size, "XOR V%X, V%X", x, y); return;
+                case 0x4: snprintf(out, size, "ADD V%X, V%X", x, y); return;
+                case 0x5: snprintf(out, size, "SUB V%X, V%X", x, y); return;
+                case 0x6: snprintf(out, size, "SHR V%X", x); return;
+                case 0x7: snprintf(out, size, "SUBN V%X, V%X", x, y); return;
+                case 0xE: snprintf(out, size, "SHL V%X", x); return;
+                default: break;
+            }
+            break;
+        case 0x9: snprintf(out, size, "SNE V%X, V%X", x, y); return;
+        case 0xA: snprintf(out, size, "LD I, 0x%03X", nnn); return;
+        case 0xB: snprintf(out, size, "JP V0, 0x%03X", nnn); return;
+        case 0xC: snprintf(out, size, "RND V%X, 0x%02X", x, kk); return;
+        case 0xD: snprintf(out, size, "DRW V%X, V%X, %u", x, y, n); return;
+        case 0xE:
+            if (kk == 0x9E) {
+                snprintf(out, size, "SKP V%X", x);
+                return;
+            } else if (kk == 0xA1) {
+                snprintf(out, size, "SKNP V%X", x);
+                return;
+            }
+            break;
+        case 0xF:
+            switch (kk) {
+                case 0x07: snprintf(out, size, "LD V%X, DT", x); return;
+                case 0x0A: snprintf(out, size, "LD V%X, K", x); return;
+                case 0x15: snprintf(out, size, "LD DT, V%X", x); return;
+                case 0x18: snprintf(out, size, "LD ST, V%X", x); return;
+                case 0x1E: snprintf(out, size, "ADD I, V%X", x); return;
+                case 0x29: snprintf(out, size, "LD F, V%X", x); return;
+                case 0x33: snprintf(out, size, "LD B, V%X", x); return;
+                case 0x55: snprintf(out, size, "LD [I], V%X", x); return;
+                case 0x65: snprintf(out, size, "LD V%X, [I]", x); return;
+                default: break;
+            }
+            break;
+        default:
+            break;
+    }
+
+    snprintf(out, size, "DW 0x%04X", opcode);
+}
@@ -1,8 +1,29 @@
 #include "error.h"
 
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
 
+// Per thread so a worker can recover from errors in its own machine
+static THREAD_LOCAL void (*error_handler)(void* data) = NULL;
+static THREAD_LOCAL void* error_data = NULL;
+
+void SetErrorHandler(void (*handler)(void* data), void* data) {
+    error_handler = handler;
+    error_data = data;
+}
 
 void error(const char* msg) {
     fprintf(stderr, "[ERROR] %s\n", msg);
+
+    // Clear first so an error inside the handler does not loop
+    void (*handler)(void*) = error_handler;
+    error_handler = NULL;
+    if (handler) {
+        handler(error_data);
+    }
+
     exit(EXIT_FAILURE);
 }
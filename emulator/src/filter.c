@@ -0,0 +1,270 @@
+#include "filter.h"
+#include "error.h"
+#include "chip8.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+enum { FILTER_MAX_THREADS = 16, BANDS_PER_THREAD = 4 };
+
+// Per channel averages on packed pixels, no carries across bytes
+static inline uint32_t Average(uint32_t a, uint32_t b) {
+    return (a & b) + (((a ^ b) & 0xFEFEFEFEu) >> 1u);
+}
+
+// 3 parts b to 1 part a
+static inline uint32_t Quarter(uint32_t a, uint32_t b) {
+    return Average(Average(a, b), b);
+}
+
+/*
+    One output pixel of scale2x. near is the source row on the side of the
+    output row, far the other one, side the source pixel on the side of the
+    output column and other the one opposite.
+*/
+static inline uint32_t Corner(uint32_t center, uint32_t near, uint32_t far, uint32_t side, uint32_t other, bool blend) {
+    bool edge = side == near && near != other && side != far;
+    uint32_t corner = blend ? Quarter(center, side) : side;
+    return edge ? corner : center;
+}
+
+static void RunScale2x(FilterStage const* stage, int begin, int end, bool blend) {
+    int width = stage->in_width;
+    int last = stage->in_height - 1;
+
+    for (int y = begin; y < end; ++y) {
+        int sy = y / 2;
+        uint32_t const* row = &stage->in[sy * width];
+        uint32_t const* above = &stage->in[(sy > 0 ? sy - 1 : 0) * width];
+        uint32_t const* below = &stage->in[(sy < last ? sy + 1 : last) * width];
+        uint32_t const* near = (y & 1) ? below : above;
+        uint32_t const* far = (y & 1) ? above : below;
+        uint32_t* out = &stage->out[y * stage->out_width];
+
+        // Edges clamp, the middle runs without any index checks
+        out[0] = Corner(row[0], near[0], far[0], row[0], row[1], blend);
+        out[1] = Corner(row[0], near[0], far[0], row[1], row[0], blend);
+
+        for (int x = 1; x < width - 1; ++x) {
+            uint32_t center = row[x];
+            out[x * 2] = Corner(center, near[x], far[x], row[x - 1], row[x + 1], blend);
+            out[x * 2 + 1] = Corner(center, near[x], far[x], row[x + 1], row[x - 1], blend);
+        }
+
+        int x = width - 1;
+        out[x * 2] = Corner(row[x], near[x], far[x], row[x - 1], row[x], blend);
+        out[x * 2 + 1] = Corner(row[x], near[x], far[x], row[x], row[x - 1], blend);
+    }
+}
+
+static void RunFit(Filter const* filter, FilterStage const* stage, int begin, int end) {
+    int width = stage->out_width;
+
+    for (int y = begin; y < end; ++y) {
+        uint32_t const* row = &stage->in[(y * stage->in_height / stage->out_height) * stage->in_width];
+        uint32_t* out = &stage->out[y * width];
+
+        for (int x = 0; x < width; ++x) {
+            out[x] = row[filter->columns[x]];
+        }
+
+        if (!filter->crt) {
+            continue;
+        }
+
+        // Phosphor mask, a quarter off the two channels this column does not show
+        for (int x = 0; x < width; ++x) {
+            out[x] -= (out[x] >> 2u) & filter->mask[x];
+        }
+
+        // Scanlines, odd rows at 5/8
+        if (y & 1) {
+            for (int x = 0; x < width; ++x) {
+                uint32_t pixel = out[x];
+                out[x] = pixel - ((pixel >> 2u) & 0x3F3F3F00u) - ((pixel >> 3u) & 0x1F1F1F00u);
+            }
+        }
+    }
+}
+
+// Take bands of the current stage until there are none left
+static void RunBands(Filter* filter) {
+    FilterStage const* stage = &filter->stages[filter->current];
+
+    for (;;) {
+        int band = SDL_AtomicAdd(&filter->next_band, 1);
+        if (band >= filter->band_count) {
+            return;
+        }
+
+        int begin = stage->out_height * band / filter->band_count;
+        int end = stage->out_height * (band + 1) / filter->band_count;
+
+        switch (stage->kind) {
+            case FILTER_SCALE2X:
+                RunScale2x(stage, begin, end, false);
+                break;
+            case FILTER_HQ2X:
+                RunScale2x(stage, begin, end, true);
+                break;
+            case FILTER_FIT:
+                RunFit(filter, stage, begin, end);
+                break;
+        }
+    }
+}
+
+static int Worker(void* data) {
+    Filter* filter = data;
+
+    for (;;) {
+        SDL_SemWait(filter->start);
+        if (filter->quit) {
+            return 0;
+        }
+        RunBands(filter);
+        SDL_SemPost(filter->done);
+    }
+}
+
+static void AddStage(Filter* filter, FilterKind kind, int width, int height) {
+    if (filter->stage_count == FILTER_MAX_STAGES) {
+        error("Too many filters");
+    }
+
+    FilterStage* stage = &filter->stages[filter->stage_count++];
+    FilterStage const* previous = filter->stage_count > 1 ? stage - 1 : NULL;
+    stage->kind = kind;
+    stage->in_width = previous ? previous->out_width : (int)CHIP8_VIDEO_WIDTH;
+    stage->in_height = previous ? previous->out_height : (int)CHIP8_VIDEO_HEIGHT;
+    stage->out_width = width ? width : stage->in_width * 2;
+    stage->out_height = height ? height : stage->in_height * 2;
+}
+
+void InitFilter(Filter* filter, const char* list, int width, int height, int threads) {
+    assert(filter);
+    memset(filter, 0, sizeof(Filter));
+
+    // The fit stage is always last, leave room for it
+    while (*list) {
+        size_t length = strcspn(list, ",");
+        if (length == 3 && strncmp(list, "crt", 3) == 0) {
+            filter->crt = true;
+        } else if (length == 7 && strncmp(list, "scale2x", 7) == 0) {
+            AddStage(filter, FILTER_SCALE2X, 0, 0);
+        } else if (length == 4 && strncmp(list, "hq2x", 4) == 0) {
+            AddStage(filter, FILTER_HQ2X, 0, 0);
+        } else if (length == 4 && strncmp(list, "hq4x", 4) == 0) {
+            AddStage(filter, FILTER_HQ2X, 0, 0);
+            AddStage(filter, FILTER_HQ2X, 0, 0);
+        } else {
+            error("Unknown filter, expected scale2x, hq2x, hq4x or crt");
+        }
+
+        list += length;
+        list += *list == ',';
+    }
+    if (filter->stage_count == FILTER_MAX_STAGES) {
+        error("Too many filters");
+    }
+    AddStage(filter, FILTER_FIT, width, height);
+
+    for (uint32_t i = 0; i < filter->stage_count; ++i) {
+        FilterStage* stage = &filter->stages[i];
+        filter->buffers[i] = malloc(sizeof(uint32_t) * stage->out_width * stage->out_height);
+        if (!filter->buffers[i]) {
+            error("Could not allocate filter buffers");
+        }
+        stage->in = i > 0 ? filter->buffers[i - 1] : NULL;
+        stage->out = filter->buffers[i];
+    }
+
+    FilterStage const* fit = &filter->stages[filter->stage_count - 1];
+    filter->output = fit->out;
+    filter->width = width;
+    filter->height = height;
+
+    filter->columns = malloc(sizeof(int) * width);
+    filter->mask = malloc(sizeof(uint32_t) * width);
+    filter->last = malloc(sizeof(uint32_t) * CHIP8_VIDEO_SIZE);
+    if (!filter->columns || !filter->mask || !filter->last) {
+        error("Could not allocate filter buffers");
+    }
+    for (int x = 0; x < width; ++x) {
+        filter->columns[x] = x * fit->in_width / width;
+        // RGBA8888, alpha stays untouched
+        filter->mask[x] = 0x3F3F3F00u & ~(0xFFu << (24u - 8u * (x % 3)));
+    }
+
+    filter->thread_count = threads > 0 ? threads : SDL_GetCPUCount();
+    if (filter->thread_count > FILTER_MAX_THREADS) {
+        filter->thread_count = FILTER_MAX_THREADS;
+    }
+    if (filter->thread_count < 1) {
+        filter->thread_count = 1;
+    }
+    filter->band_count = filter->thread_count * BANDS_PER_THREAD;
+
+    filter->start = SDL_CreateSemaphore(0);
+    filter->done = SDL_CreateSemaphore(0);
+    filter->workers = malloc(sizeof(SDL_Thread*) * filter->thread_count);
+    if (!filter->start || !filter->done || !filter->workers) {
+        error("Could not create filter threads");
+    }
+
+    // The caller is a worker too
+    for (int i = 0; i < filter->thread_count - 1; ++i) {
+        filter->workers[i] = SDL_CreateThread(Worker, "filter", filter);
+        if (!filter->workers[i]) {
+            error("Could not create filter threads");
+        }
+    }
+}
+
+bool FilterFrame(Filter* filter, uint32_t const* video) {
+    assert(filter);
+    if (filter->filtered && memcmp(filter->last, video, sizeof(uint32_t) * CHIP8_VIDEO_SIZE) == 0) {
+        return false;
+    }
+    memcpy(filter->last, video, sizeof(uint32_t) * CHIP8_VIDEO_SIZE);
+    filter->stages[0].in = filter->last;
+
+    for (uint32_t i = 0; i < filter->stage_count; ++i) {
+        filter->current = i;
+        SDL_AtomicSet(&filter->next_band, 0);
+
+        for (int t = 0; t < filter->thread_count - 1; ++t) {
+            SDL_SemPost(filter->start);
+        }
+        RunBands(filter);
+        for (int t = 0; t < filter->thread_count - 1; ++t) {
+            SDL_SemWait(filter->done);
+        }
+    }
+
+    filter->filtered = true;
+    return true;
+}
+
+void DestroyFilter(Filter* filter) {
+    assert(filter);
+    filter->quit = true;
+    for (int i = 0; i < filter->thread_count - 1; ++i) {
+        SDL_SemPost(filter->start);
+    }
+    for (int i = 0; i < filter->thread_count - 1; ++i) {
+        SDL_WaitThread(filter->workers[i], NULL);
+    }
+
+    SDL_DestroySemaphore(filter->start);
+    SDL_DestroySemaphore(filter->done);
+    free(filter->workers);
+    for (uint32_t i = 0; i < filter->stage_count; ++i) {
+        free(filter->buffers[i]);
+    }
+    free(filter->columns);
+    free(filter->mask);
+    free(filter->last);
+    memset(filter, 0, sizeof(Filter));
+}
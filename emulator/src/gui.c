@@ -3,6 +3,75 @@
 #include <string.h>
 #include <assert.h>
 
+// 3x5 overlay font, one octal digit per row with the msb on the left
+static const char GLYPH_CHARS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.%/:-";
+static const uint16_t GLYPHS[] = {
+    075557, 026227, 071747, 071717, 055711, 074717, 074757, 071122, 075757, 075717,
+    025755, 065656, 034443, 065556, 074647, 074644, 034553, 055755, 072227, 011152,
+    055655, 044447, 057755, 065555, 025552, 065644, 025563, 065655, 034216, 072222,
+    055557, 055552, 055775, 055255, 055222, 071247, 000002, 051245, 011244, 002020,
+    000700
+};
+
+enum { OVERLAY_MAX_RECTS = 512 };
+
+// Light text on a dark box, one rect per lit font pixel
+static void DrawOverlay(Gui* gui, const char* text) {
+    int size = gui->height / 160 > 1 ? gui->height / 160 : 1;
+    int columns = 0;
+    int lines = 1;
+    for (int x = 0, i = 0; text[i]; ++i) {
+        x = text[i] == '\n' ? 0 : x + 1;
+        lines += text[i] == '\n';
+        columns = x > columns ? x : columns;
+    }
+
+    SDL_Rect box = { 0, 0, (columns * 4 + 1) * size, (lines * 6 + 1) * size };
+    SDL_SetRenderDrawColor(gui->renderer, 0, 0, 0, 255);
+    SDL_RenderFillRect(gui->renderer, &box);
+
+    SDL_Rect rects[OVERLAY_MAX_RECTS];
+    int count = 0;
+    int x = 0;
+    int y = 0;
+    for (const char* c = text; *c; ++c) {
+        if (*c == '\n') {
+            x = 0;
+            y += 1;
+            continue;
+        }
+
+        const char* found = strchr(GLYPH_CHARS, *c);
+        uint16_t glyph = found ? GLYPHS[found - GLYPH_CHARS] : 0;
+        for (int bit = 0; bit < 15; ++bit) {
+            if (!(glyph & (1u << (14 - bit)))) {
+                continue;
+            }
+            if (count == OVERLAY_MAX_RECTS) {
+                SDL_SetRenderDrawColor(gui->renderer, 0, 255, 0, 255);
+                SDL_RenderFillRects(gui->renderer, rects, count);
+                count = 0;
+            }
+            rects[count++] = (SDL_Rect){ (x * 4 + 1 + bit % 3) * size, (y * 6 + 1 + bit / 3) * size, size, size };
+        }
+        x += 1;
+    }
+
+    SDL_SetRenderDrawColor(gui->renderer, 0, 255, 0, 255);
+    SDL_RenderFillRects(gui->renderer, rects, count);
+    SDL_SetRenderDrawColor(gui->renderer, 0, 0, 0, 255);
+}
+
+// Stretch the texture over the window, one copy per refresh
+static void Render(Gui* gui) {
+    SDL_RenderClear(gui->renderer);
+    SDL_RenderCopy(gui->renderer, gui->texture, NULL, NULL);
+    if (gui->overlay) {
+        DrawOverlay(gui, gui->overlay);
+    }
+    SDL_RenderPresent(gui->renderer);
+}
+
 void InitGui(Gui* gui, const char* title, int width, int height, int twidth, int theight) {
     assert(gui);
 
@@ -28,6 +97,9 @@ void InitGui(Gui* gui, const char* title, int width, int height, int twidth, int
 		error("SDL_CreateTexture Failed");
 	}
 
+    gui->filter = NULL;
+    gui->overlay = NULL;
+    gui->height = height;
 }
 
 void DestroyGui(Gui* gui) {
@@ -40,13 +112,39 @@ void DestroyGui(Gui* gui) {
 
 void UpdateGui(Gui* gui, void const* buffer, int pitch) {
 	assert(gui);
-    SDL_UpdateTexture(gui->texture, NULL, buffer, pitch);
-    SDL_RenderClear(gui->renderer);
-    SDL_RenderCopy(gui->renderer, gui->texture, NULL, NULL);
-    SDL_RenderPresent(gui->renderer);
+    if (!gui->filter) {
+        SDL_UpdateTexture(gui->texture, NULL, buffer, pitch);
+    } else if (FilterFrame(gui->filter, buffer)) {
+        // Unchanged frames keep the texture from last time
+        SDL_UpdateTexture(gui->texture, NULL, gui->filter->output, gui->filter->width * sizeof(uint32_t));
+    }
+    Render(gui);
+}
+
+void UpdateGuiRect(Gui* gui, SDL_Rect const* rect, void const* buffer, int pitch) {
+	assert(gui);
+    if (rect) {
+        SDL_UpdateTexture(gui->texture, rect, buffer, pitch);
+    }
+    Render(gui);
+}
+
+void SetGuiFilter(Gui* gui, Filter* filter) {
+	assert(gui);
+    gui->filter = filter;
+    if (!filter) {
+        return;
+    }
+
+    SDL_DestroyTexture(gui->texture);
+    gui->texture = SDL_CreateTexture(
+			gui->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, filter->width, filter->height);
+	if (!gui->texture) {
+		error("SDL_CreateTexture Failed");
+	}
 }
 
-bool ProcessInput(uint8_t* keys)
+bool ProcessInput(uint8_t* keys, Hotkeys* hotkeys, Latency* latency)
 {
 		bool quit = false;
 
@@ -54,6 +152,9 @@ bool ProcessInput(uint8_t* keys)
 
 		while (SDL_PollEvent(&event))
 		{
+			uint8_t before[16];
+			memcpy(before, keys, sizeof(before));
+
 			switch (event.type)
 			{
 				case SDL_QUIT:
@@ -70,6 +171,25 @@ bool ProcessInput(uint8_t* keys)
 							quit = true;
 						} break;
 
+						case SDLK_TAB:
+						{
+							if (!event.key.repeat) {
+								hotkeys->turbo = !hotkeys->turbo;
+							}
+						} break;
+
+						case SDLK_F3:
+						{
+							if (!event.key.repeat) {
+								hotkeys->overlay = !hotkeys->overlay;
+							}
+						} break;
+
+						case SDLK_F8:
+						{
+							hotkeys->report_latency = true;
+						} break;
+
 						case SDLK_x:
 						{
 							keys[0] = 1;
@@ -248,6 +368,12 @@ bool ProcessInput(uint8_t* keys)
                 default:
                     break;
 			}
+
+			for (uint32_t i = 0; latency && i < 16; ++i) {
+				if (keys[i] != before[i]) {
+					LatencyKeyChanged(latency, i);
+				}
+			}
 		}
 
 		return quit;
@@ -0,0 +1,110 @@
+#include "latency.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static const char* STAGE_NAMES[LATENCY_STAGES] = { "keypad", "read", "photon" };
+
+static void AddSample(Latency* latency, LatencyStage stage, Uint64 received, Uint64 now) {
+    uint64_t micros = (now - received) * 1000000u / latency->frequency;
+    latency->samples[stage][latency->counts[stage] % LATENCY_SAMPLES] = micros > UINT32_MAX ? UINT32_MAX : (uint32_t)micros;
+    latency->counts[stage] += 1;
+}
+
+static int CompareSamples(void const* a, void const* b) {
+    uint32_t x = *(uint32_t const*)a;
+    uint32_t y = *(uint32_t const*)b;
+    return (x > y) - (x < y);
+}
+
+void InitLatency(Latency* latency) {
+    assert(latency);
+    memset(latency, 0, sizeof(Latency));
+    latency->frequency = SDL_GetPerformanceFrequency();
+
+    for (uint32_t stage = 0; stage < LATENCY_STAGES; ++stage) {
+        latency->samples[stage] = malloc(sizeof(uint32_t) * LATENCY_SAMPLES);
+        if (!latency->samples[stage]) {
+            error("Could not allocate latency samples");
+        }
+    }
+}
+
+void LatencyKeyChanged(Latency* latency, uint32_t key) {
+    assert(latency && key < 16);
+    LatencyKey* pending = &latency->keys[key];
+    if (pending->received && !(pending->reached & (1u << LATENCY_READ))) {
+        latency->unread += 1;
+    }
+
+    pending->received = SDL_GetPerformanceCounter();
+    pending->reached = 0;
+}
+
+void LatencyFrame(Latency* latency, Chip8* chip, Uint64 started) {
+    assert(latency && chip);
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    for (uint32_t key = 0; key < 16; ++key) {
+        LatencyKey* pending = &latency->keys[key];
+        // Changes that came in while this frame ran wait for the next one
+        if (!pending->received || pending->received > started) {
+            continue;
+        }
+
+        if (!(pending->reached & (1u << LATENCY_KEYPAD))) {
+            AddSample(latency, LATENCY_KEYPAD, pending->received, started);
+            pending->reached |= 1u << LATENCY_KEYPAD;
+        }
+        if (!(pending->reached & (1u << LATENCY_READ)) && (chip->keys_read & (1u << key))) {
+            AddSample(latency, LATENCY_READ, pending->received, now);
+            pending->reached |= 1u << LATENCY_READ;
+        }
+    }
+
+    chip->keys_read = 0;
+}
+
+void LatencyPresented(Latency* latency) {
+    assert(latency);
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    for (uint32_t key = 0; key < 16; ++key) {
+        LatencyKey* pending = &latency->keys[key];
+        if (pending->reached & (1u << LATENCY_READ)) {
+            AddSample(latency, LATENCY_PHOTON, pending->received, now);
+            memset(pending, 0, sizeof(LatencyKey));
+        }
+    }
+}
+
+void ReportLatency(Latency const* latency) {
+    assert(latency);
+    uint32_t sorted[LATENCY_SAMPLES];
+
+    fprintf(stderr, "[LATENCY] %llu key changes, %lu never read\n",
+            (unsigned long long)latency->counts[LATENCY_KEYPAD], latency->unread);
+    for (uint32_t stage = 0; stage < LATENCY_STAGES; ++stage) {
+        size_t count = latency->counts[stage] < LATENCY_SAMPLES ? latency->counts[stage] : LATENCY_SAMPLES;
+        if (count == 0) {
+            fprintf(stderr, "[LATENCY] %-6s no samples\n", STAGE_NAMES[stage]);
+            continue;
+        }
+
+        memcpy(sorted, latency->samples[stage], sizeof(uint32_t) * count);
+        qsort(sorted, count, sizeof(uint32_t), CompareSamples);
+        fprintf(stderr, "[LATENCY] %-6s p50 %.2fms p99 %.2fms max %.2fms (%zu samples)\n", STAGE_NAMES[stage],
+                sorted[count / 2] / 1000.0, sorted[(count * 99) / 100] / 1000.0, sorted[count - 1] / 1000.0, count);
+    }
+}
+
+void DestroyLatency(Latency* latency) {
+    assert(latency);
+    for (uint32_t stage = 0; stage < LATENCY_STAGES; ++stage) {
+        free(latency->samples[stage]);
+    }
+    memset(latency, 0, sizeof(Latency));
+}
@@ -1,58 +1,514 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include <time.h>
+#include <string.h>
 #include "error.h"
 #include "rom.h"
 #include "gui.h"
 #include "chip8.h"
+#include "options.h"
+#include "capture.h"
+#include "debugger.h"
+#include "watch.h"
+#include "trace.h"
+#include "metrics.h"
+#include "mosaic.h"
+#if defined(CHIPPY_POSIX)
+#include "stream.h"
+#include "netplay.h"
+#include "shared.h"
+#include "terminal.h"
+#endif
 
 // Hack Try to include the system headers first
 #include "SDL.h"
 
-int main(int argc, char** argv) {
-    if (argc != 4) {
-		error("Usage: chippy <scale> <delay> <rom>");
+// Everything that consumes finished frames, NULL when not enabled
+typedef struct {
+	Capture* capture;
+#if defined(CHIPPY_POSIX)
+	StreamServer* stream;
+	SharedFrames* shared;
+#endif
+} Sinks;
+
+// Called on every 60Hz frame boundary
+static void EndFrame(Sinks* sinks, Chip8* chip8) {
+	if (sinks->capture) {
+		CaptureFrame(sinks->capture, chip8);
+	}
+#if defined(CHIPPY_POSIX)
+	if (sinks->stream) {
+		StreamPublish(sinks->stream, chip8);
+		StreamPoll(sinks->stream, chip8);
+	}
+	if (sinks->shared) {
+		SharedPublish(sinks->shared, chip8);
+	}
+#endif
+}
+
+// What drives the machine through a frame, NULL when not enabled
+typedef struct {
+	Debugger* debugger;
+#if defined(CHIPPY_POSIX)
+	Netplay* netplay;
+#endif
+} Engine;
+
+typedef enum {
+	FRAME_DONE,
+	// Netplay is waiting on the peer, nothing ran
+	FRAME_STALLED,
+	FRAME_QUIT
+} FrameResult;
+
+// Run count instructions, the debug engine only when a debugger is attached. Returns false on quit
+static bool RunCycles(Chip8* chip8, int count, Debugger* debugger) {
+	if (debugger) {
+		for (int i = 0; i < count; ++i) {
+			if (!DebuggerCycle(debugger, chip8)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		Chip8Cycle(chip8);
+	}
+	return true;
+}
+
+// One emulated 60Hz frame: the instructions, the timers, then the frame sinks
+static FrameResult RunFrame(Chip8* chip8, int cycles_per_frame, Sinks* sinks, Engine* engine) {
+#if defined(CHIPPY_POSIX)
+	if (engine->netplay) {
+		if (!NetplayAdvance(engine->netplay, chip8, cycles_per_frame)) {
+			return FRAME_STALLED;
+		}
+		EndFrame(sinks, chip8);
+		return FRAME_DONE;
+	}
+#endif
+
+	if (!RunCycles(chip8, cycles_per_frame, engine->debugger)) {
+		return FRAME_QUIT;
+	}
+
+	Chip8TickTimers(chip8);
+	EndFrame(sinks, chip8);
+	return FRAME_DONE;
+}
+
+// Netplay owns the keypad and takes the local keys on the side
+static uint8_t* InputKeypad(Chip8* chip8, Engine* engine) {
+#if defined(CHIPPY_POSIX)
+	if (engine->netplay) {
+		return engine->netplay->keys;
 	}
+#else
+	(void)engine;
+#endif
+	return chip8->keypad;
+}
+
+// Emulate as fast as possible
+static void RunHeadless(Chip8* chip8, Options const* options, Sinks* sinks, Engine* engine, Metrics* metrics) {
+	for (unsigned long frame = 0; frame < options->frames;) {
+		FrameResult result = RunFrame(chip8, options->cycles_per_frame, sinks, engine);
+		if (result == FRAME_QUIT) {
+			return;
+		}
+		if (result != FRAME_DONE) {
+			continue;
+		}
+
+		frame += 1;
+		MetricsFrame(metrics, options->cycles_per_frame);
+		// Frames are short here, only look at the clock now and then
+		if (frame % 1024 == 0) {
+			MetricsUpdate(metrics);
+		}
+	}
+}
+
+// The front end the paced loop takes keys from and shows frames on
+typedef bool (*FrontendInput)(void* frontend, uint8_t* keys, Hotkeys* hotkeys, Latency* latency);
+typedef void (*FrontendPresent)(void* frontend, Chip8* chip8);
+
+// Show the latest frame, each present is what latency counts as the photon
+static void Present(FrontendPresent present, void* frontend, Chip8* chip8, Latency* latency, Metrics* metrics) {
+	MetricsSwitch(metrics, METRICS_PRESENT);
+	present(frontend, chip8);
+	MetricsPresented(metrics);
+	if (latency) {
+		LatencyPresented(latency);
+	}
+}
 
-	int scale = atoi(argv[1]);
-	int delay = atoi(argv[2]);
-	char const* romname = argv[3];
+/*
+	Paced on the host clock, one display refresh every 1/60s. Each refresh runs
+	options->speed emulated frames, or in turbo as many as fit in the refresh.
+	Only the latest frame is presented, or every frameskip'th frame if set, so
+	rendering never runs more than the display can show.
+*/
+static void RunPaced(Chip8* chip8, Options const* options, Sinks* sinks, Engine* engine, Metrics* metrics,
+					 FrontendInput input, FrontendPresent present, void* frontend) {
+	Latency latency_stats;
+	Latency* latency = NULL;
+	if (options->latency) {
+		InitLatency(&latency_stats);
+		latency = &latency_stats;
+	}
+
+	bool quit = false;
+	Hotkeys hotkeys = { .turbo = options->turbo, .overlay = options->overlay };
+
+	Uint64 refresh = SDL_GetPerformanceFrequency() / 60;
+	Uint64 next_refresh = SDL_GetPerformanceCounter();
+	unsigned long frame = 0;
+
+	// Game Loop
+	while (!quit) {
+		MetricsSwitch(metrics, METRICS_INPUT);
+		quit = input(frontend, InputKeypad(chip8, engine), &hotkeys, latency);
+		if (hotkeys.report_latency) {
+			hotkeys.report_latency = false;
+			if (latency) {
+				ReportLatency(latency);
+			}
+		}
+
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (now < next_refresh) {
+			MetricsSwitch(metrics, METRICS_IDLE);
+			SDL_Delay(1);
+			continue;
+		}
+
+		// After a long stall (debugger prompt, window drag) pick up from now instead of racing to catch up
+		if (now - next_refresh > refresh * 4) {
+			next_refresh = now;
+		}
+		next_refresh += refresh;
+
+		unsigned long frames = 0;
+		do {
+			MetricsSwitch(metrics, METRICS_RUN);
+			Uint64 started = SDL_GetPerformanceCounter();
+			FrameResult result = RunFrame(chip8, options->cycles_per_frame, sinks, engine);
+			if (result == FRAME_QUIT) {
+				quit = true;
+			}
+			if (result != FRAME_DONE) {
+				break;
+			}
+			if (latency) {
+				LatencyFrame(latency, chip8, started);
+			}
+			MetricsFrame(metrics, options->cycles_per_frame);
+			frame += 1;
+			frames += 1;
+
+			if (options->frameskip && frame % options->frameskip == 0) {
+				Present(present, frontend, chip8, latency, metrics);
+			}
+		} while (hotkeys.turbo ? SDL_GetPerformanceCounter() < next_refresh : frames < options->speed);
+
+		if (!options->frameskip) {
+			Present(present, frontend, chip8, latency, metrics);
+		}
+		MetricsUpdate(metrics);
+	}
+
+	if (latency) {
+		ReportLatency(latency);
+		DestroyLatency(latency);
+	}
+}
+
+typedef struct {
+	Gui gui;
+	Metrics* metrics;
+} Window;
+
+static bool WindowInput(void* frontend, uint8_t* keys, Hotkeys* hotkeys, Latency* latency) {
+	Window* window = frontend;
+	bool quit = ProcessInput(keys, hotkeys, latency);
+	window->gui.overlay = hotkeys->overlay ? window->metrics->text : NULL;
+	return quit;
+}
+
+static void WindowPresent(void* frontend, Chip8* chip8) {
+	Window* window = frontend;
+	UpdateGui(&window->gui, chip8->video, sizeof(chip8->video[0]) * CHIP8_VIDEO_WIDTH);
+}
+
+static void RunGui(Chip8* chip8, Options const* options, Sinks* sinks, Engine* engine, Metrics* metrics, const char* title) {
+	Window window = { .metrics = metrics };
+	InitGui(&window.gui, title, CHIP8_VIDEO_WIDTH * options->scale, CHIP8_VIDEO_HEIGHT * options->scale, CHIP8_VIDEO_WIDTH, CHIP8_VIDEO_HEIGHT);
+
+	Filter filter;
+	if (options->filter_list) {
+		InitFilter(&filter, options->filter_list, CHIP8_VIDEO_WIDTH * options->scale, CHIP8_VIDEO_HEIGHT * options->scale, options->filter_threads);
+		SetGuiFilter(&window.gui, &filter);
+	}
+
+	RunPaced(chip8, options, sinks, engine, metrics, WindowInput, WindowPresent, &window);
+
+	if (options->filter_list) {
+		DestroyFilter(&filter);
+	}
+	DestroyGui(&window.gui);
+}
+
+#if defined(CHIPPY_POSIX)
+static bool ConsoleInput(void* frontend, uint8_t* keys, Hotkeys* hotkeys, Latency* latency) {
+	return TerminalInput(frontend, keys, hotkeys, latency);
+}
+
+static void ConsolePresent(void* frontend, Chip8* chip8) {
+	TerminalDraw(frontend, chip8);
+}
+
+// SDL is only the clock here, no window and no SDL_Init
+static void RunTerminal(Chip8* chip8, Options const* options, Sinks* sinks, Engine* engine, Metrics* metrics) {
+	Terminal terminal;
+	OpenTerminal(&terminal);
+	RunPaced(chip8, options, sinks, engine, metrics, ConsoleInput, ConsolePresent, &terminal);
+	CloseTerminal(&terminal);
+}
+#endif
+
+/*
+	Paced like RunGui. Every machine runs the same frames per refresh and takes
+	the same keys, then the tiles that changed go up in one upload.
+*/
+static void RunMosaic(Rom const* rom, Options const* options, Metrics* metrics) {
+	uint32_t count = (uint32_t)options->mosaic;
+	Chip8Image* image = Chip8CreateImage(rom);
+	Chip8* chips = calloc(count, sizeof(Chip8));
+	if (!chips) {
+		error("Could not allocate mosaic machines");
+	}
+
+	// Seeds apart so copies of a rom that uses CXKK do not all play the same
+	uint32_t seed = (uint32_t)SDL_GetPerformanceCounter();
+	for (uint32_t i = 0; i < count; ++i) {
+		Chip8Init(&chips[i]);
+		Chip8LoadImage(&chips[i], image);
+		Chip8Seed(&chips[i], seed + i);
+	}
+
+	Mosaic mosaic;
+	InitMosaic(&mosaic, count);
+	Gui gui;
+	InitGui(&gui, rom->name, mosaic.width * options->scale, mosaic.height * options->scale, mosaic.width, mosaic.height);
+
+	bool quit = false;
+	uint8_t keys[16] = { 0 };
+	Hotkeys hotkeys = { .turbo = options->turbo, .overlay = options->overlay };
+
+	Uint64 refresh = SDL_GetPerformanceFrequency() / 60;
+	Uint64 next_refresh = SDL_GetPerformanceCounter();
+
+	while (!quit) {
+		MetricsSwitch(metrics, METRICS_INPUT);
+		quit = ProcessInput(keys, &hotkeys, NULL);
+		gui.overlay = hotkeys.overlay ? metrics->text : NULL;
+
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (now < next_refresh) {
+			MetricsSwitch(metrics, METRICS_IDLE);
+			SDL_Delay(1);
+			continue;
+		}
+		if (now - next_refresh > refresh * 4) {
+			next_refresh = now;
+		}
+		next_refresh += refresh;
+
+		for (uint32_t i = 0; i < count; ++i) {
+			memcpy(chips[i].keypad, keys, sizeof(keys));
+		}
+
+		unsigned long frames = 0;
+		do {
+			MetricsSwitch(metrics, METRICS_RUN);
+			for (uint32_t i = 0; i < count; ++i) {
+				for (int cycle = 0; cycle < options->cycles_per_frame; ++cycle) {
+					Chip8Cycle(&chips[i]);
+				}
+				Chip8TickTimers(&chips[i]);
+			}
+			MetricsFrame(metrics, options->cycles_per_frame * count);
+			frames += 1;
+		} while (hotkeys.turbo ? SDL_GetPerformanceCounter() < next_refresh : frames < options->speed);
+
+		MetricsSwitch(metrics, METRICS_PRESENT);
+		SDL_Rect dirty;
+		if (MosaicUpdate(&mosaic, chips, &dirty)) {
+			uint32_t const* corner = &mosaic.pixels[dirty.y * mosaic.width + dirty.x];
+			UpdateGuiRect(&gui, &dirty, corner, mosaic.width * sizeof(uint32_t));
+		} else {
+			UpdateGuiRect(&gui, NULL, NULL, 0);
+		}
+		MetricsPresented(metrics);
+		MetricsUpdate(metrics);
+	}
+
+	DestroyGui(&gui);
+	DestroyMosaic(&mosaic);
+	for (uint32_t i = 0; i < count; ++i) {
+		Chip8Release(&chips[i]);
+	}
+	free(chips);
+	Chip8DestroyImage(&image);
+}
+
+// A mosaic is only the machines and one window, nothing else hooks into them
+static bool MosaicAlone(Options const* options) {
+	bool others = options->headless || options->debug || options->watch_list || options->trace_path ||
+				  options->filter_list || options->capture_path || options->latency || options->frameskip;
+#if defined(CHIPPY_POSIX)
+	others = others || options->terminal || options->stream_address || options->shm_name || options->netplay_address;
+#endif
+	return !others;
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	ParseOptions(&options, argc, argv);
 
 	// Rom
-	Rom* rom = LoadRom(romname);
+	Rom* rom = LoadRom(options.rom_path);
+	if (!rom) {
+		error("Could not load rom");
+	}
+
+	if (options.mosaic) {
+		if (options.mosaic > MOSAIC_MAX || !MosaicAlone(&options)) {
+			error("--mosaic takes 1 to 4096 machines and only runs with --ipf, --speed, --turbo, --overlay and --stats");
+		}
+		Metrics metrics;
+		InitMetrics(&metrics, options.stats_path);
+		RunMosaic(rom, &options, &metrics);
+		CloseMetrics(&metrics);
+		DestroyRom(&rom);
+		return EXIT_SUCCESS;
+	}
+
+#if defined(CHIPPY_POSIX)
+	// The terminal owns stdin, the debugger prompt would fight it for keys
+	if (options.terminal && (options.headless || options.debug || options.filter_list || options.overlay)) {
+		error("--terminal does not run with --headless, --debug, --filter or --overlay");
+	}
+#endif
 
 	// Chip8
 	Chip8 chip8;
 	Chip8Init(&chip8);
 	Chip8LoadRom(&chip8, rom);
 
-	// Gui
-	Gui gui;
-	InitGui(&gui, rom->name, CHIP8_VIDEO_WIDTH * scale, CHIP8_VIDEO_HEIGHT * scale, CHIP8_VIDEO_WIDTH, CHIP8_VIDEO_HEIGHT);
+	// Frame sinks
+	Sinks sinks = { 0 };
 
-	bool quit = false;
-	int videopitch = sizeof(chip8.video[0]) * CHIP8_VIDEO_WIDTH;
+	Capture capture;
+	if (options.capture_path) {
+		OpenCapture(&capture, options.capture_path, options.scale);
+		sinks.capture = &capture;
+	}
 
-	clock_t last_time = clock();
+#if defined(CHIPPY_POSIX)
+	StreamServer stream;
+	if (options.stream_address) {
+		OpenStreamServer(&stream, options.stream_address);
+		sinks.stream = &stream;
+	}
 
-	// Game Loop
-	while (!quit) {
-		quit = ProcessInput(chip8.keypad);
+	SharedFrames shared;
+	if (options.shm_name) {
+		OpenSharedFrames(&shared, options.shm_name);
+		sinks.shared = &shared;
+	}
+#endif
+
+	// Debugger, watchpoints and tracing all run on the debug engine
+	Engine engine = { 0 };
+	Debugger debugger;
+	Watch watch;
+	Trace trace;
 
-		clock_t current_time = clock();
-		float delta_time = (float)((current_time - last_time ) * 1000) / CLOCKS_PER_SEC;
+	if (options.debug || options.watch_list || options.trace_path) {
+		InitDebugger(&debugger, options.debug);
+		engine.debugger = &debugger;
+	}
 
-		if (delta_time > delay) {
-			last_time = current_time;
-			Chip8Cycle(&chip8);
-			UpdateGui(&gui, chip8.video, videopitch);
+	if (options.debug || options.watch_list) {
+		InitWatch(&watch);
+		if (options.watch_list && !ParseWatchList(&watch, options.watch_list)) {
+			error("Bad --watch list, expected e.g. w:200-2ff,r:300");
 		}
+		chip8.watch = &watch;
+	}
 
+	if (options.trace_path) {
+		OpenTrace(&trace, options.trace_path, options.trace_size);
+		debugger.trace = &trace;
 	}
 
+#if defined(CHIPPY_POSIX)
+	// Both sides must start from the same machine, rollback replaces the debug engine
+	Netplay netplay;
+	if (options.netplay_address) {
+		if (engine.debugger) {
+			error("--netplay does not run with --debug, --watch or --trace");
+		}
+		OpenNetplay(&netplay, options.netplay_address);
+		SetNetplayConditions(&netplay, options.net_delay, options.net_loss);
+		Chip8Seed(&chip8, NETPLAY_SEED);
+		engine.netplay = &netplay;
+	}
+#endif
+
+	Metrics metrics;
+	InitMetrics(&metrics, options.stats_path);
+
+	if (options.headless) {
+		RunHeadless(&chip8, &options, &sinks, &engine, &metrics);
+#if defined(CHIPPY_POSIX)
+	} else if (options.terminal) {
+		RunTerminal(&chip8, &options, &sinks, &engine, &metrics);
+#endif
+	} else {
+		RunGui(&chip8, &options, &sinks, &engine, &metrics, rom->name);
+	}
+	CloseMetrics(&metrics);
+
+#if defined(CHIPPY_POSIX)
+	if (engine.netplay) {
+		CloseNetplay(engine.netplay);
+	}
+#endif
+
+	if (options.trace_path) {
+		CloseTrace(&trace);
+	}
+
+	if (sinks.capture) {
+		CloseCapture(sinks.capture);
+	}
+#if defined(CHIPPY_POSIX)
+	if (sinks.stream) {
+		CloseStreamServer(sinks.stream);
+	}
+	if (sinks.shared) {
+		CloseSharedFrames(sinks.shared);
+	}
+#endif
+
+	Chip8Release(&chip8);
 	DestroyRom(&rom);
-	DestroyGui(&gui);
 	return EXIT_SUCCESS;
 }
-
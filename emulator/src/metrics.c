@@ -0,0 +1,139 @@
+#include "metrics.h"
+#include "error.h"
+
+#include <string.h>
+#include <assert.h>
+
+static const char* PHASE_NAMES[METRICS_PHASES] = { "input", "run", "present", "idle" };
+
+static double Milliseconds(Metrics const* metrics, Uint64 ticks) {
+    return ticks * 1000.0 / metrics->frequency;
+}
+
+// Upper edge in ms of the bucket holding the given fraction of presents
+static double Percentile(Metrics const* metrics, double fraction) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < METRICS_BUCKETS; ++i) {
+        total += metrics->histogram[i];
+    }
+
+    uint64_t wanted = (uint64_t)(total * fraction);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < METRICS_BUCKETS - 1; ++i) {
+        seen += metrics->histogram[i];
+        if (seen > wanted) {
+            return i + 1;
+        }
+    }
+    return Milliseconds(metrics, metrics->max_frame);
+}
+
+void InitMetrics(Metrics* metrics, const char* stats_path) {
+    assert(metrics);
+    memset(metrics, 0, sizeof(Metrics));
+    metrics->frequency = SDL_GetPerformanceFrequency();
+    metrics->started = SDL_GetPerformanceCounter();
+    metrics->period_start = metrics->started;
+    metrics->phase = METRICS_RUN;
+    metrics->phase_start = metrics->started;
+    strcpy(metrics->text, "IPS -");
+
+    if (stats_path) {
+        metrics->file = fopen(stats_path, "w");
+        if (!metrics->file) {
+            error("Could not open stats file");
+        }
+    }
+}
+
+void MetricsSwitch(Metrics* metrics, MetricsPhase phase) {
+    assert(metrics && phase < METRICS_PHASES);
+    Uint64 now = SDL_GetPerformanceCounter();
+    metrics->phase_ticks[metrics->phase] += now - metrics->phase_start;
+    metrics->phase = phase;
+    metrics->phase_start = now;
+}
+
+void MetricsPresented(Metrics* metrics) {
+    assert(metrics);
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (metrics->last_present) {
+        Uint64 frame = now - metrics->last_present;
+        uint64_t bucket = frame * 1000u / metrics->frequency;
+        metrics->histogram[bucket < METRICS_BUCKETS - 1 ? bucket : METRICS_BUCKETS - 1] += 1;
+        if (frame > metrics->max_frame) {
+            metrics->max_frame = frame;
+        }
+    }
+    metrics->last_present = now;
+    metrics->presented += 1;
+}
+
+// Summarise the period up to now and start the next one
+static void EndPeriod(Metrics* metrics, Uint64 now) {
+    Uint64 period = now - metrics->period_start;
+    metrics->phase_ticks[metrics->phase] += now - metrics->phase_start;
+    metrics->phase_start = now;
+    double seconds = (double)period / metrics->frequency;
+    double ips = metrics->instructions / seconds;
+    uint64_t skipped = metrics->frames > metrics->presented ? metrics->frames - metrics->presented : 0;
+    double percents[METRICS_PHASES];
+    for (uint32_t i = 0; i < METRICS_PHASES; ++i) {
+        percents[i] = 100.0 * metrics->phase_ticks[i] / period;
+    }
+    double p50 = Percentile(metrics, 0.5);
+    double p99 = Percentile(metrics, 0.99);
+    double max = Milliseconds(metrics, metrics->max_frame);
+
+    snprintf(metrics->text, sizeof(metrics->text),
+             "IPS %.2fM FPS %.0f/%.0f SKIP %llu\nRUN %.0f%% GUI %.0f%% IN %.0f%% IDLE %.0f%%\nFRAME P50 %.0f P99 %.0f MAX %.1fMS",
+             ips / 1e6, metrics->presented / seconds, metrics->frames / seconds, (unsigned long long)skipped,
+             percents[METRICS_RUN], percents[METRICS_PRESENT], percents[METRICS_INPUT], percents[METRICS_IDLE],
+             p50, p99, max);
+
+    if (metrics->file) {
+        fprintf(metrics->file, "time=%.3f ips=%.0f frames=%llu presented=%llu skipped=%llu",
+                Milliseconds(metrics, now - metrics->started) / 1000.0, ips, (unsigned long long)metrics->frames,
+                (unsigned long long)metrics->presented, (unsigned long long)skipped);
+        for (uint32_t i = 0; i < METRICS_PHASES; ++i) {
+            fprintf(metrics->file, " %s_ms=%.3f", PHASE_NAMES[i], Milliseconds(metrics, metrics->phase_ticks[i]));
+        }
+        fprintf(metrics->file, " frame_p50_ms=%.0f frame_p99_ms=%.0f frame_max_ms=%.3f frame_hist=", p50, p99, max);
+        for (uint32_t i = 0; i < METRICS_BUCKETS; ++i) {
+            fprintf(metrics->file, "%s%u", i ? "," : "", (unsigned)metrics->histogram[i]);
+        }
+        fprintf(metrics->file, "\n");
+        fflush(metrics->file);
+    }
+
+    memset(metrics->phase_ticks, 0, sizeof(metrics->phase_ticks));
+    memset(metrics->histogram, 0, sizeof(metrics->histogram));
+    metrics->instructions = 0;
+    metrics->frames = 0;
+    metrics->presented = 0;
+    metrics->max_frame = 0;
+    metrics->period_start = now;
+}
+
+bool MetricsUpdate(Metrics* metrics) {
+    assert(metrics);
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now - metrics->period_start < metrics->frequency) {
+        return false;
+    }
+    EndPeriod(metrics, now);
+    return true;
+}
+
+void CloseMetrics(Metrics* metrics) {
+    assert(metrics);
+    if (metrics->file) {
+        // The partial period since the last line, runs under a second included
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now > metrics->period_start) {
+            EndPeriod(metrics, now);
+        }
+        fclose(metrics->file);
+    }
+    memset(metrics, 0, sizeof(Metrics));
+}
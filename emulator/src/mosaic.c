@@ -0,0 +1,110 @@
+#include "mosaic.h"
+#include "error.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// RGBA8888 like the single window texture
+#define MOSAIC_ON 0xFFFFFFFFu
+#define MOSAIC_OFF 0x000000FFu
+#define MOSAIC_BORDER 0x404040FFu
+
+// Tile plus its border on the right and bottom
+#define TILE_STRIDE_X (CHIP8_VIDEO_WIDTH + 1)
+#define TILE_STRIDE_Y (CHIP8_VIDEO_HEIGHT + 1)
+
+static void DrawTile(Mosaic* mosaic, uint32_t tile, uint8_t const* frame) {
+    uint32_t* origin = mosaic->pixels + (tile / mosaic->columns) * TILE_STRIDE_Y * mosaic->width +
+                       (tile % mosaic->columns) * TILE_STRIDE_X;
+    for (uint32_t y = 0; y < CHIP8_VIDEO_HEIGHT; ++y) {
+        uint32_t* row = origin + y * mosaic->width;
+        for (uint32_t x = 0; x < CHIP8_VIDEO_WIDTH; ++x) {
+            uint32_t i = y * CHIP8_VIDEO_WIDTH + x;
+            row[x] = (frame[i / 8] >> (7 - i % 8)) & 0x1u ? MOSAIC_ON : MOSAIC_OFF;
+        }
+    }
+}
+
+void InitMosaic(Mosaic* mosaic, uint32_t count) {
+    assert(mosaic);
+    assert(count > 0 && count <= MOSAIC_MAX);
+
+    // Square grid of 2:1 tiles keeps the 2:1 window of a single machine
+    mosaic->count = count;
+    mosaic->columns = 1;
+    while (mosaic->columns * mosaic->columns < count) {
+        mosaic->columns += 1;
+    }
+    mosaic->rows = (count + mosaic->columns - 1) / mosaic->columns;
+    mosaic->width = (int)(mosaic->columns * TILE_STRIDE_X - 1);
+    mosaic->height = (int)(mosaic->rows * TILE_STRIDE_Y - 1);
+    mosaic->pixels = malloc(sizeof(uint32_t) * mosaic->width * mosaic->height);
+    mosaic->frames = calloc(count, CHIP8_VIDEO_BYTES);
+    if (!mosaic->pixels || !mosaic->frames) {
+        error("Could not allocate mosaic");
+    }
+
+    // Borders everywhere, then a blank screen per tile to match the zeroed frames
+    for (int i = 0; i < mosaic->width * mosaic->height; ++i) {
+        mosaic->pixels[i] = MOSAIC_BORDER;
+    }
+    for (uint32_t tile = 0; tile < count; ++tile) {
+        DrawTile(mosaic, tile, mosaic->frames[tile]);
+    }
+    mosaic->changed = 0;
+    mosaic->uploaded = false;
+}
+
+void DestroyMosaic(Mosaic* mosaic) {
+    assert(mosaic);
+    free(mosaic->pixels);
+    free(mosaic->frames);
+    mosaic->pixels = NULL;
+    mosaic->frames = NULL;
+}
+
+bool MosaicUpdate(Mosaic* mosaic, Chip8 const* chips, SDL_Rect* dirty) {
+    assert(mosaic && chips && dirty);
+
+    uint32_t left = mosaic->columns;
+    uint32_t right = 0;
+    uint32_t top = mosaic->rows;
+    uint32_t bottom = 0;
+    mosaic->changed = 0;
+
+    for (uint32_t tile = 0; tile < mosaic->count; ++tile) {
+        uint8_t frame[CHIP8_VIDEO_BYTES];
+        Chip8PackVideo(&chips[tile], frame);
+        if (memcmp(frame, mosaic->frames[tile], CHIP8_VIDEO_BYTES) == 0) {
+            continue;
+        }
+        memcpy(mosaic->frames[tile], frame, CHIP8_VIDEO_BYTES);
+        DrawTile(mosaic, tile, frame);
+        mosaic->changed += 1;
+
+        uint32_t column = tile % mosaic->columns;
+        uint32_t row = tile / mosaic->columns;
+        left = column < left ? column : left;
+        right = column > right ? column : right;
+        top = row < top ? row : top;
+        bottom = row > bottom ? row : bottom;
+    }
+
+    if (!mosaic->uploaded) {
+        // The texture starts out undefined
+        mosaic->uploaded = true;
+        *dirty = (SDL_Rect){ 0, 0, mosaic->width, mosaic->height };
+        return true;
+    }
+    if (mosaic->changed == 0) {
+        return false;
+    }
+    *dirty = (SDL_Rect){
+        (int)(left * TILE_STRIDE_X),
+        (int)(top * TILE_STRIDE_Y),
+        (int)((right - left) * TILE_STRIDE_X + CHIP8_VIDEO_WIDTH),
+        (int)((bottom - top) * TILE_STRIDE_Y + CHIP8_VIDEO_HEIGHT),
+    };
+    return true;
+}
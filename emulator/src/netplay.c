@@ -0,0 +1,351 @@
+#include "netplay.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+// Unacked keys are sent again this often so a lost packet cannot hang both sides
+static const uint64_t RESEND_NS = 16000000u;
+// Stalled this long without hearing from the peer, it is gone
+static const uint64_t TIMEOUT_NS = 10000000000u;
+
+static uint64_t Now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+static NetplayFrame* Slot(Netplay* netplay, uint32_t frame) {
+    return &netplay->frames[frame & (NETPLAY_WINDOW - 1)];
+}
+
+static void PutU32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = (value >> (8u * i)) & 0xFFu;
+    }
+}
+
+static uint32_t GetU32(uint8_t const* bytes) {
+    return bytes[0] | (bytes[1] << 8u) | (bytes[2] << 16u) | ((uint32_t)bytes[3] << 24u);
+}
+
+static uint16_t KeyMask(uint8_t const* keys) {
+    uint16_t mask = 0;
+    for (int i = 0; i < 16; ++i) {
+        mask |= (keys[i] ? 1u : 0u) << i;
+    }
+    return mask;
+}
+
+// Snapshot, then one frame with both players' keys on the keypad
+static void RunFrame(Netplay* netplay, Chip8* chip, uint32_t frame, uint32_t cycles) {
+    NetplayFrame* slot = Slot(netplay, frame);
+    slot->frame = frame;
+    Chip8SaveState(chip, &slot->state);
+    slot->hash = Chip8HashState(chip);
+
+    uint16_t mask = slot->local | slot->remote;
+    for (int i = 0; i < 16; ++i) {
+        chip->keypad[i] = (mask >> i) & 0x1u;
+    }
+
+    for (uint32_t i = 0; i < cycles; ++i) {
+        Chip8Cycle(chip);
+    }
+    Chip8TickTimers(chip);
+}
+
+static void Rollback(Netplay* netplay, Chip8* chip, uint32_t from, uint32_t cycles) {
+    uint64_t start = Now();
+    Chip8LoadState(chip, &Slot(netplay, from)->state);
+
+    for (uint32_t frame = from; frame < netplay->frame; ++frame) {
+        if (frame >= netplay->remote_frames) {
+            Slot(netplay, frame)->remote = netplay->last_remote;
+        }
+        RunFrame(netplay, chip, frame, cycles);
+    }
+
+    uint64_t elapsed = Now() - start;
+    netplay->rollbacks += 1;
+    netplay->resimulated += netplay->frame - from;
+    if (netplay->frame - from > netplay->max_rollback) {
+        netplay->max_rollback = netplay->frame - from;
+    }
+    if (elapsed > netplay->max_rollback_ns) {
+        netplay->max_rollback_ns = elapsed;
+    }
+}
+
+static void SendPacket(Netplay* netplay, uint8_t const* bytes, uint32_t length) {
+    sendto(netplay->fd, bytes, length, 0, (struct sockaddr const*)&netplay->peer, sizeof(netplay->peer));
+}
+
+// Send what is due from the delay queue, it is in due order since the delay is fixed
+static void FlushQueue(Netplay* netplay) {
+    uint64_t now = Now();
+    uint32_t sent = 0;
+
+    while (sent < netplay->queue_length && netplay->queue[sent].due <= now) {
+        SendPacket(netplay, netplay->queue[sent].bytes, netplay->queue[sent].length);
+        sent += 1;
+    }
+
+    netplay->queue_length -= sent;
+    memmove(netplay->queue, &netplay->queue[sent], sizeof(NetplayPacket) * netplay->queue_length);
+}
+
+static void SendKeys(Netplay* netplay) {
+    uint8_t packet[NETPLAY_MAX_PACKET];
+    uint32_t first = netplay->peer_ack;
+    uint32_t count = netplay->frame - first;
+    if (count > NETPLAY_WINDOW) {
+        count = NETPLAY_WINDOW;
+    }
+
+    uint32_t length = 0;
+    packet[length++] = 'N';
+    packet[length++] = count;
+    PutU32(&packet[length], first);
+    length += 4;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint16_t keys = Slot(netplay, first + i)->local;
+        packet[length++] = keys & 0xFFu;
+        packet[length++] = keys >> 8u;
+    }
+    PutU32(&packet[length], netplay->remote_frames);
+    length += 4;
+
+    // The start of this frame only depends on inputs that are all known
+    uint32_t check = netplay->remote_frames < netplay->frame ? netplay->remote_frames : netplay->frame - 1;
+    uint64_t hash = netplay->frame > 0 ? Slot(netplay, check)->hash : 0;
+    PutU32(&packet[length], check);
+    PutU32(&packet[length + 4], hash & 0xFFFFFFFFu);
+    PutU32(&packet[length + 8], hash >> 32u);
+    length += 12;
+
+    netplay->last_send = Now();
+
+    if (netplay->loss_percent) {
+        netplay->random ^= netplay->random << 13u;
+        netplay->random ^= netplay->random >> 17u;
+        netplay->random ^= netplay->random << 5u;
+        if (netplay->random % 100 < netplay->loss_percent) {
+            return;
+        }
+    }
+
+    if (netplay->delay_ms == 0) {
+        SendPacket(netplay, packet, length);
+        return;
+    }
+
+    // A full queue behaves like loss
+    if (netplay->queue_length < NETPLAY_QUEUE_SIZE) {
+        NetplayPacket* queued = &netplay->queue[netplay->queue_length++];
+        queued->due = netplay->last_send + (uint64_t)netplay->delay_ms * 1000000u;
+        queued->length = length;
+        memcpy(queued->bytes, packet, length);
+    }
+}
+
+// Returns the oldest frame that ran on a wrong prediction, or netplay->frame if none did
+static uint32_t ReadPacket(Netplay* netplay, uint8_t const* packet, size_t length) {
+    uint32_t rollback = netplay->frame;
+
+    if (length < 6 || packet[0] != 'N' || length != 6u + packet[1] * 2u + 16u) {
+        return rollback;
+    }
+
+    uint32_t count = packet[1];
+    uint32_t first = GetU32(&packet[2]);
+    uint8_t const* tail = &packet[6 + count * 2];
+
+    uint32_t ack = GetU32(&tail[0]);
+    if (ack > netplay->peer_ack && ack <= netplay->frame) {
+        netplay->peer_ack = ack;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t frame = first + i;
+        if (frame < netplay->remote_frames) {
+            continue;
+        }
+        // Out of order with a gap, or further ahead than the ring holds
+        if (frame != netplay->remote_frames || frame >= netplay->frame + NETPLAY_WINDOW / 2) {
+            break;
+        }
+
+        uint16_t keys = packet[6 + i * 2] | (packet[7 + i * 2] << 8u);
+        NetplayFrame* slot = Slot(netplay, frame);
+        if (frame < netplay->frame && slot->remote != keys && frame < rollback) {
+            rollback = frame;
+        }
+
+        slot->remote = keys;
+        netplay->remote_frames = frame + 1;
+        netplay->last_remote = keys;
+    }
+
+    uint64_t hash = GetU32(&tail[8]) | ((uint64_t)GetU32(&tail[12]) << 32u);
+    if (hash && GetU32(&tail[4]) >= netplay->check_frame) {
+        netplay->check_frame = GetU32(&tail[4]);
+        netplay->check_hash = hash;
+    }
+    return rollback;
+}
+
+// Compare the peer's hash once our state for the same frame is final too
+static void CheckSync(Netplay* netplay) {
+    uint32_t frame = netplay->check_frame;
+    if (!netplay->check_hash || frame > netplay->remote_frames || frame >= netplay->frame) {
+        return;
+    }
+
+    NetplayFrame* slot = Slot(netplay, frame);
+    if (slot->frame == frame && slot->hash != netplay->check_hash) {
+        if (netplay->desyncs == 0) {
+            fprintf(stderr, "[NETPLAY] Desync at frame %u\n", (unsigned)frame);
+        }
+        netplay->desyncs += 1;
+    }
+    netplay->check_hash = 0;
+}
+
+void OpenNetplay(Netplay* netplay, const char* address) {
+    assert(netplay);
+    memset(netplay, 0, sizeof(Netplay));
+
+    char host[256];
+    unsigned local_port = 0;
+    unsigned peer_port = 0;
+    if (sscanf(address, "%u:%255[^:]:%u", &local_port, host, &peer_port) != 3 || local_port > 0xFFFF || peer_port > 0xFFFF) {
+        error("Netplay address must be localport:host:port");
+    }
+
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo* found = NULL;
+    if (getaddrinfo(host, NULL, &hints, &found) != 0 || !found) {
+        error("Could not resolve netplay peer");
+    }
+    memcpy(&netplay->peer, found->ai_addr, sizeof(netplay->peer));
+    netplay->peer.sin_port = htons(peer_port);
+    freeaddrinfo(found);
+
+    struct sockaddr_in local = { .sin_family = AF_INET };
+    local.sin_port = htons(local_port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    netplay->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (netplay->fd < 0 || bind(netplay->fd, (struct sockaddr*)&local, sizeof(local)) < 0) {
+        error("Could not bind netplay socket");
+    }
+
+    int flags = fcntl(netplay->fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(netplay->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        error("Could not make netplay socket non blocking");
+    }
+
+    netplay->frames = calloc(NETPLAY_WINDOW, sizeof(NetplayFrame));
+    netplay->queue = malloc(sizeof(NetplayPacket) * NETPLAY_QUEUE_SIZE);
+    if (!netplay->frames || !netplay->queue) {
+        error("Could not allocate netplay frames");
+    }
+    netplay->random = local_port | 1u;
+    netplay->last_receive = Now();
+}
+
+void SetNetplayConditions(Netplay* netplay, unsigned delay_ms, unsigned loss_percent) {
+    assert(netplay);
+    netplay->delay_ms = delay_ms;
+    netplay->loss_percent = loss_percent > 100 ? 100 : loss_percent;
+}
+
+void NetplayPoll(Netplay* netplay, Chip8* chip, uint32_t cycles) {
+    assert(netplay);
+    uint8_t packet[NETPLAY_MAX_PACKET];
+    uint32_t rollback = netplay->frame;
+
+    for (;;) {
+        ssize_t length = recv(netplay->fd, packet, sizeof(packet), 0);
+        if (length < 0) {
+            break;
+        }
+
+        netplay->last_receive = Now();
+        uint32_t wrong = ReadPacket(netplay, packet, length);
+        if (wrong < rollback) {
+            rollback = wrong;
+        }
+    }
+
+    if (rollback < netplay->frame) {
+        Rollback(netplay, chip, rollback, cycles);
+    }
+
+    CheckSync(netplay);
+
+    // Nothing new went out for a while and the peer is missing keys, a packet got lost
+    if (netplay->peer_ack < netplay->frame && Now() - netplay->last_send >= RESEND_NS) {
+        SendKeys(netplay);
+    }
+    FlushQueue(netplay);
+}
+
+bool NetplayAdvance(Netplay* netplay, Chip8* chip, uint32_t cycles) {
+    assert(netplay);
+    NetplayPoll(netplay, chip, cycles);
+
+    if (netplay->frame >= netplay->remote_frames + NETPLAY_MAX_ROLLBACK ||
+        netplay->frame - netplay->peer_ack >= NETPLAY_WINDOW / 2) {
+        netplay->stalls += 1;
+        if (Now() - netplay->last_receive > TIMEOUT_NS) {
+            error("Netplay peer stopped responding");
+        }
+
+        // Give the peer a moment instead of spinning
+        struct pollfd wait = { .fd = netplay->fd, .events = POLLIN };
+        poll(&wait, 1, 1);
+        return false;
+    }
+
+    uint32_t frame = netplay->frame;
+    NetplayFrame* slot = Slot(netplay, frame);
+    slot->local = KeyMask(netplay->keys);
+    if (frame >= netplay->remote_frames) {
+        slot->remote = netplay->last_remote;
+    }
+
+    RunFrame(netplay, chip, frame, cycles);
+    netplay->frame += 1;
+
+    SendKeys(netplay);
+    return true;
+}
+
+void CloseNetplay(Netplay* netplay) {
+    assert(netplay);
+    fprintf(stderr, "[NETPLAY] %u frames, %lu rollbacks (%lu frames again, deepest %lu, slowest %.2fms), %lu stalls, %lu desyncs\n",
+            (unsigned)netplay->frame, netplay->rollbacks, netplay->resimulated, netplay->max_rollback,
+            netplay->max_rollback_ns / 1e6, netplay->stalls, netplay->desyncs);
+
+    // The peer may still need our last keys to finish its own frames
+    for (uint32_t i = 0; i < netplay->queue_length; ++i) {
+        SendPacket(netplay, netplay->queue[i].bytes, netplay->queue[i].length);
+    }
+
+    close(netplay->fd);
+    free(netplay->frames);
+    free(netplay->queue);
+    memset(netplay, 0, sizeof(Netplay));
+}
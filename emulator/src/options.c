@@ -0,0 +1,160 @@
+#include "options.h"
+#include "error.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+// Instructions a frame, ipf times the largest mosaic still fits the 32 bit instruction counts
+#define OPTIONS_MAX_IPF (1U << 16U)
+// Emulated frames a refresh, past this --turbo is the better fit
+#define OPTIONS_MAX_SPEED 1000U
+
+static const char* USAGE =
+    "Usage: chippy [options] <scale> <delay> <rom>\n"
+    "  <delay> is milliseconds per instruction, 0 for the --ipf default\n"
+    "  --headless          run without a window, unthrottled\n"
+    "  --frames=N          stop a headless run after N frames (default 36000)\n"
+    "  --ipf=N             instructions per 60Hz frame, up to 65536 (default from delay, else 10)\n"
+    "  --speed=N           run N times faster than real time, up to 1000\n"
+    "  --turbo             run unthrottled, tab toggles it while playing\n"
+    "  --frameskip=K       present every Kth frame instead of the latest one per refresh\n"
+    "  --overlay           show speed and frame time counters, F3 toggles them\n"
+    "  --stats=FILE        append a line of counters per second to FILE\n"
+    "  --latency           measure key to screen latency, printed on exit and with F8\n"
+    "  --filter=LIST       filter the display, e.g. hq2x,crt (scale2x, hq2x, hq4x, crt)\n"
+    "  --filter-threads=N  threads for --filter (default one per core)\n"
+    "  --mosaic=N          run N copies of the rom tiled in one window, keys go to all of them\n"
+    "  --capture=FILE      record frames to FILE (.raw, .y4m or .gif)\n"
+    "  --trace=FILE        keep the last instructions in a ring, written to FILE on exit or error\n"
+    "  --trace-size=N      instructions kept by --trace (default 65536)\n"
+    "  --debug             start paused in the debugger, ctrl-c breaks back in\n"
+    "  --watch=LIST        report accesses, e.g. w:200-2ff,r:300 (self modifying code is always reported)\n"
+#if defined(CHIPPY_POSIX)
+    "  --terminal          play in the terminal with half block characters instead of a window\n"
+    "  --stream=ADDR       serve frames to viewers on unix:<path> or tcp:<port>\n"
+    "  --shm=/NAME         publish frames and take keys through shared memory /NAME\n"
+    "  --netplay=ADDR      two player rollback session, <localport>:<host>:<port>\n"
+    "  --net-delay=MS      delay outgoing netplay packets, for testing\n"
+    "  --net-loss=PERCENT  drop outgoing netplay packets, for testing\n"
+#endif
+    ;
+
+// Returns the value of --name=value or NULL when arg is not that option
+static const char* OptionValue(const char* arg, const char* name) {
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) == 0 && arg[length] == '=') {
+        return arg + length + 1;
+    }
+    return NULL;
+}
+
+static long ParseNumber(const char* text) {
+    char* end = NULL;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || value < 0) {
+        error(USAGE);
+    }
+    return value;
+}
+
+// ParseNumber for values that feed instruction counts, checked before they are narrowed
+static long ParseLimited(const char* text, unsigned long max) {
+    long value = ParseNumber(text);
+    if ((unsigned long)value > max) {
+        error(USAGE);
+    }
+    return value;
+}
+
+void ParseOptions(Options* options, int argc, char** argv) {
+    assert(options);
+    memset(options, 0, sizeof(Options));
+    options->frames = 36000;
+    options->speed = 1;
+    options->trace_size = 65536;
+
+    const char* positional[3];
+    int count = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = NULL;
+
+        if (strncmp(arg, "--", 2) != 0) {
+            if (count == 3) {
+                error(USAGE);
+            }
+            positional[count++] = arg;
+        } else if (strcmp(arg, "--headless") == 0) {
+            options->headless = true;
+        } else if (strcmp(arg, "--turbo") == 0) {
+            options->turbo = true;
+        } else if (strcmp(arg, "--overlay") == 0) {
+            options->overlay = true;
+        } else if ((value = OptionValue(arg, "--stats"))) {
+            options->stats_path = value;
+        } else if (strcmp(arg, "--latency") == 0) {
+            options->latency = true;
+        } else if ((value = OptionValue(arg, "--speed"))) {
+            options->speed = ParseLimited(value, OPTIONS_MAX_SPEED);
+        } else if ((value = OptionValue(arg, "--frameskip"))) {
+            options->frameskip = ParseNumber(value);
+        } else if (strcmp(arg, "--debug") == 0) {
+            options->debug = true;
+        } else if ((value = OptionValue(arg, "--frames"))) {
+            options->frames = ParseNumber(value);
+        } else if ((value = OptionValue(arg, "--ipf"))) {
+            options->cycles_per_frame = (int)ParseLimited(value, OPTIONS_MAX_IPF);
+        } else if ((value = OptionValue(arg, "--watch"))) {
+            options->watch_list = value;
+        } else if ((value = OptionValue(arg, "--trace"))) {
+            options->trace_path = value;
+        } else if ((value = OptionValue(arg, "--trace-size"))) {
+            options->trace_size = ParseNumber(value);
+        } else if ((value = OptionValue(arg, "--filter"))) {
+            options->filter_list = value;
+        } else if ((value = OptionValue(arg, "--filter-threads"))) {
+            options->filter_threads = ParseNumber(value);
+        } else if ((value = OptionValue(arg, "--mosaic"))) {
+            options->mosaic = ParseNumber(value);
+        } else if ((value = OptionValue(arg, "--capture"))) {
+            options->capture_path = value;
+#if defined(CHIPPY_POSIX)
+        } else if (strcmp(arg, "--terminal") == 0) {
+            options->terminal = true;
+        } else if ((value = OptionValue(arg, "--stream"))) {
+            options->stream_address = value;
+        } else if ((value = OptionValue(arg, "--shm"))) {
+            options->shm_name = value;
+        } else if ((value = OptionValue(arg, "--netplay"))) {
+            options->netplay_address = value;
+        } else if ((value = OptionValue(arg, "--net-delay"))) {
+            options->net_delay = ParseNumber(value);
+        } else if ((value = OptionValue(arg, "--net-loss"))) {
+            options->net_loss = ParseNumber(value);
+#endif
+        } else {
+            error(USAGE);
+        }
+    }
+
+    if (count != 3) {
+        error(USAGE);
+    }
+
+    options->scale = atoi(positional[0]);
+    options->delay = atoi(positional[1]);
+    options->rom_path = positional[2];
+
+    // The delay argument used to be the wait between instructions, keep that speed
+    if (options->cycles_per_frame == 0) {
+        options->cycles_per_frame = options->delay > 0 ? 1000 / (60 * options->delay) : 10;
+        if (options->cycles_per_frame == 0) {
+            options->cycles_per_frame = 1;
+        }
+    }
+    if (options->speed == 0) {
+        options->speed = 1;
+    }
+}
@@ -0,0 +1,94 @@
+#include "perf.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const struct {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+} EVENTS[PERF_COUNTERS] = {
+    [PERF_CYCLES] = { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_INSTRUCTIONS] = { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_BRANCH_MISSES] = { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [PERF_L1D_MISSES] = { "L1d-misses", PERF_TYPE_HW_CACHE,
+                          PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8u) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16u) },
+    [PERF_LLC_MISSES] = { "LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+bool OpenPerf(Perf* perf) {
+    memset(perf, 0, sizeof(Perf));
+    perf->group = -1;
+
+    for (uint32_t i = 0; i < PERF_COUNTERS; ++i) {
+        perf->fds[i] = -1;
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = EVENTS[i].type;
+        attr.config = EVENTS[i].config;
+        // The leader starts the whole group at once below
+        attr.disabled = perf->group < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, perf->group, 0);
+        if (fd < 0) {
+            continue;
+        }
+        if (perf->group < 0) {
+            perf->group = fd;
+        }
+        perf->fds[i] = fd;
+        perf->slots[i] = perf->count++;
+    }
+
+    if (perf->group < 0) {
+        return false;
+    }
+    ioctl(perf->group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf->group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+bool PerfRead(Perf const* perf, PerfSample* sample) {
+    // nr, time enabled, time running, then one value per counter
+    uint64_t data[3 + PERF_COUNTERS];
+    memset(sample, 0, sizeof(PerfSample));
+
+    ssize_t expected = (ssize_t)(sizeof(uint64_t) * (3 + perf->count));
+    if (perf->group < 0 || read(perf->group, data, sizeof(data)) < expected) {
+        return false;
+    }
+    for (uint32_t i = 0; i < PERF_COUNTERS; ++i) {
+        if (perf->fds[i] >= 0) {
+            sample->values[i] = data[3 + perf->slots[i]];
+        }
+    }
+    return data[2] > 0;
+}
+
+bool PerfHas(Perf const* perf, PerfCounter counter) {
+    return perf->fds[counter] >= 0;
+}
+
+const char* PerfName(PerfCounter counter) {
+    return EVENTS[counter].name;
+}
+
+void ClosePerf(Perf* perf) {
+    for (uint32_t i = 0; i < PERF_COUNTERS; ++i) {
+        if (perf->fds[i] >= 0) {
+            close(perf->fds[i]);
+        }
+        perf->fds[i] = -1;
+    }
+    perf->group = -1;
+    perf->count = 0;
+}
@@ -0,0 +1,164 @@
+#include "shared.h"
+#include "error.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t SegmentSize(uint32_t slot_count) {
+    return sizeof(SharedHeader) + sizeof(SharedSlot) * slot_count;
+}
+
+static void* MapSegment(int fd, size_t size, int protection) {
+    void* memory = mmap(NULL, size, protection, MAP_SHARED, fd, 0);
+    return memory == MAP_FAILED ? NULL : memory;
+}
+
+void OpenSharedFrames(SharedFrames* shared, const char* name) {
+    assert(shared);
+    memset(shared, 0, sizeof(SharedFrames));
+    if (name[0] != '/' || strchr(name + 1, '/')) {
+        error("Shared memory name must look like /name");
+    }
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        error("Could not create shared memory");
+    }
+
+    shared->size = SegmentSize(SHARED_SLOTS);
+    if (ftruncate(fd, shared->size) < 0) {
+        error("Could not size shared memory");
+    }
+    void* memory = MapSegment(fd, shared->size, PROT_READ | PROT_WRITE);
+    close(fd);
+    if (!memory) {
+        error("Could not map shared memory");
+    }
+
+    shared->name = strdup(name);
+    shared->header = memory;
+    shared->slots = (SharedSlot*)(shared->header + 1);
+
+    // ftruncate zeroed everything, the magic goes last so readers never see half a header
+    shared->header->version = SHARED_VERSION;
+    shared->header->slot_count = SHARED_SLOTS;
+    shared->header->slot_size = sizeof(SharedSlot);
+    shared->header->width = CHIP8_VIDEO_WIDTH;
+    shared->header->height = CHIP8_VIDEO_HEIGHT;
+    atomic_thread_fence(memory_order_release);
+    shared->header->magic = SHARED_MAGIC;
+}
+
+void SharedPublish(SharedFrames* shared, Chip8* chip) {
+    assert(shared && chip);
+    SharedHeader* header = shared->header;
+    uint64_t frame = atomic_load_explicit(&header->frame, memory_order_relaxed) + 1;
+    SharedSlot* slot = &shared->slots[frame % SHARED_SLOTS];
+
+    uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->frame = frame;
+    memcpy(slot->registers, chip->registers, sizeof(slot->registers));
+    memcpy(slot->stack, chip->stack, sizeof(slot->stack));
+    slot->index = chip->index;
+    slot->pc = chip->pc;
+    slot->sp = chip->sp;
+    slot->delay_timer = chip->delay_timer;
+    slot->sound_timer = chip->sound_timer;
+    slot->keypad = 0;
+    for (uint32_t i = 0; i < 16; ++i) {
+        slot->keypad |= (chip->keypad[i] ? 1u : 0u) << i;
+    }
+    for (uint32_t i = 0; i < CHIP8_VIDEO_SIZE; ++i) {
+        slot->pixels[i] = chip->video[i] ? 1 : 0;
+    }
+
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&header->frame, frame, memory_order_release);
+
+    uint32_t keys = atomic_load_explicit(&header->keys, memory_order_relaxed) & 0xFFFFu;
+    uint32_t changed = keys ^ shared->keys;
+    for (uint32_t i = 0; changed && i < 16; ++i) {
+        if (changed & (1u << i)) {
+            chip->keypad[i] = (keys >> i) & 0x1u;
+        }
+    }
+    shared->keys = keys;
+}
+
+void CloseSharedFrames(SharedFrames* shared) {
+    assert(shared);
+    munmap(shared->header, shared->size);
+    shm_unlink(shared->name);
+    free(shared->name);
+    memset(shared, 0, sizeof(SharedFrames));
+}
+
+bool AttachSharedFrames(SharedFrames* shared, const char* name) {
+    assert(shared);
+    memset(shared, 0, sizeof(SharedFrames));
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    SharedHeader* header = NULL;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(SharedHeader)) {
+        header = MapSegment(fd, info.st_size, PROT_READ | PROT_WRITE);
+    }
+    close(fd);
+    if (!header) {
+        return false;
+    }
+
+    bool valid = header->magic == SHARED_MAGIC && header->version == SHARED_VERSION &&
+                 header->slot_size == sizeof(SharedSlot) && header->slot_count > 0 &&
+                 (size_t)info.st_size >= SegmentSize(header->slot_count);
+    atomic_thread_fence(memory_order_acquire);
+    if (!valid) {
+        munmap(header, info.st_size);
+        return false;
+    }
+
+    shared->header = header;
+    shared->slots = (SharedSlot*)(header + 1);
+    shared->size = info.st_size;
+    return true;
+}
+
+bool SharedReadFrame(SharedFrames const* shared, uint64_t frame, SharedSlot* out) {
+    assert(shared && out);
+    SharedSlot const* slot = &shared->slots[frame % shared->header->slot_count];
+
+    // A writer that laps the reader shows up as a changed sequence, try again a few times
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        uint32_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (before & 1u) {
+            continue;
+        }
+
+        memcpy(out, slot, sizeof(SharedSlot));
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t after = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+        if (before == after) {
+            return out->frame == frame;
+        }
+    }
+    return false;
+}
+
+void DetachSharedFrames(SharedFrames* shared) {
+    assert(shared);
+    munmap(shared->header, shared->size);
+    memset(shared, 0, sizeof(SharedFrames));
+}
@@ -0,0 +1,282 @@
+#include "stream.h"
+#include "error.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static void SetNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        error("Could not make stream socket non blocking");
+    }
+}
+
+// Xor old and new then run length code the zero runs, returns the full message size
+static size_t EncodeDelta(uint8_t const* old, uint8_t const* frame, uint32_t sequence, uint8_t* out) {
+    size_t length = 7;
+
+    for (size_t i = 0; i < CHIP8_VIDEO_BYTES;) {
+        uint8_t byte = old[i] ^ frame[i];
+
+        if (byte) {
+            out[length++] = byte;
+            i += 1;
+            continue;
+        }
+
+        uint8_t run = 0;
+        while (i < CHIP8_VIDEO_BYTES && run < UINT8_MAX && old[i] == frame[i]) {
+            run += 1;
+            i += 1;
+        }
+        out[length++] = 0x00;
+        out[length++] = run;
+    }
+
+    uint16_t payload = length - 7;
+    out[0] = 'F';
+    out[1] = sequence & 0xFFu;
+    out[2] = (sequence >> 8u) & 0xFFu;
+    out[3] = (sequence >> 16u) & 0xFFu;
+    out[4] = (sequence >> 24u) & 0xFFu;
+    out[5] = payload & 0xFFu;
+    out[6] = (payload >> 8u) & 0xFFu;
+    return length;
+}
+
+// Bring a viewer up to the published frame if its buffer has room, otherwise it waits for the next one
+static void QueueFrame(StreamServer* server, StreamClient* client) {
+    if (client->sequence == server->sequence) {
+        return;
+    }
+
+    uint8_t message[STREAM_MAX_MESSAGE];
+    uint8_t const* bytes = server->delta;
+    size_t length = server->delta_length;
+
+    if (client->sequence + 1 != server->sequence) {
+        length = EncodeDelta(client->frame, server->frame, server->sequence, message);
+        bytes = message;
+    }
+
+    if (STREAM_BUFFER_SIZE - client->out_length < length) {
+        return;
+    }
+
+    memcpy(&client->out[client->out_length], bytes, length);
+    client->out_length += length;
+    memcpy(client->frame, server->frame, CHIP8_VIDEO_BYTES);
+    client->sequence = server->sequence;
+}
+
+static void DropClient(StreamServer* server, size_t i) {
+    close(server->clients[i].fd);
+    server->client_count -= 1;
+    server->clients[i] = server->clients[server->client_count];
+}
+
+static void AcceptClients(StreamServer* server) {
+    for (;;) {
+        int fd = accept(server->fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+
+        if (server->client_count == STREAM_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+
+        SetNonBlocking(fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        StreamClient* client = &server->clients[server->client_count++];
+        memset(client, 0, sizeof(StreamClient));
+        client->fd = fd;
+        QueueFrame(server, client);
+    }
+}
+
+// Returns false once the viewer has gone away
+static bool ReadClient(StreamClient* client, Chip8* chip) {
+    uint8_t buffer[256];
+
+    for (;;) {
+        ssize_t count = recv(client->fd, buffer, sizeof(buffer), 0);
+        if (count == 0) {
+            return false;
+        }
+        if (count < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        for (ssize_t i = 0; i < count; ++i) {
+            client->in[client->in_length++] = buffer[i];
+            if (client->in_length == 2) {
+                if (client->in[0] < 16) {
+                    chip->keypad[client->in[0]] = client->in[1] ? 1 : 0;
+                }
+                client->in_length = 0;
+            }
+        }
+    }
+}
+
+static bool WriteClient(StreamClient* client) {
+    while (client->out_length > 0) {
+        ssize_t count = send(client->fd, client->out, client->out_length, 0);
+        if (count < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        client->out_length -= count;
+        memmove(client->out, &client->out[count], client->out_length);
+    }
+    return true;
+}
+
+void OpenStreamServer(StreamServer* server, const char* address) {
+    assert(server);
+    memset(server, 0, sizeof(StreamServer));
+
+    // A viewer closing mid write should not kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un local = { .sun_family = AF_UNIX };
+        const char* path = address + 5;
+        if (strlen(path) >= sizeof(local.sun_path)) {
+            error("Stream socket path is too long");
+        }
+        strcpy(local.sun_path, path);
+        // Only clear a stale socket, never some other file at a mistyped path
+        struct stat existing;
+        if (lstat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+            unlink(path);
+        }
+
+        server->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server->fd < 0 || bind(server->fd, (struct sockaddr*)&local, sizeof(local)) < 0) {
+            error("Could not bind stream unix socket");
+        }
+        server->path = strdup(path);
+    } else if (strncmp(address, "tcp:", 4) == 0) {
+        struct sockaddr_in local = { .sin_family = AF_INET };
+        local.sin_port = htons(atoi(address + 4));
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int one = 1;
+        server->fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (server->fd >= 0) {
+            setsockopt(server->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (server->fd < 0 || bind(server->fd, (struct sockaddr*)&local, sizeof(local)) < 0) {
+            error("Could not bind stream tcp socket");
+        }
+    } else {
+        error("Stream address must be unix:<path> or tcp:<port>");
+    }
+
+    if (listen(server->fd, 64) < 0) {
+        error("Could not listen on stream socket");
+    }
+    SetNonBlocking(server->fd);
+
+    server->clients = malloc(sizeof(StreamClient) * STREAM_MAX_CLIENTS);
+    server->pollfds = malloc(sizeof(struct pollfd) * (STREAM_MAX_CLIENTS + 1));
+    if (!server->clients || !server->pollfds) {
+        error("Could not allocate stream clients");
+    }
+}
+
+void StreamPublish(StreamServer* server, Chip8 const* chip) {
+    assert(server);
+    uint8_t frame[CHIP8_VIDEO_BYTES];
+    Chip8PackVideo(chip, frame);
+
+    if (server->sequence > 0 && memcmp(frame, server->frame, CHIP8_VIDEO_BYTES) == 0) {
+        return;
+    }
+
+    server->sequence += 1;
+    server->delta_length = EncodeDelta(server->frame, frame, server->sequence, server->delta);
+    memcpy(server->frame, frame, CHIP8_VIDEO_BYTES);
+
+    for (size_t i = 0; i < server->client_count; ++i) {
+        QueueFrame(server, &server->clients[i]);
+    }
+}
+
+void StreamPoll(StreamServer* server, Chip8* chip) {
+    assert(server);
+    size_t count = server->client_count;
+    struct pollfd* pollfds = server->pollfds;
+
+    pollfds[0].fd = server->fd;
+    pollfds[0].events = POLLIN;
+    for (size_t i = 0; i < count; ++i) {
+        StreamClient* client = &server->clients[i];
+
+        // Catch up anyone who was too backed up when the frame was published
+        QueueFrame(server, client);
+
+        pollfds[i + 1].fd = client->fd;
+        pollfds[i + 1].events = POLLIN | (client->out_length ? POLLOUT : 0);
+        pollfds[i + 1].revents = 0;
+    }
+
+    if (poll(pollfds, count + 1, 0) <= 0) {
+        return;
+    }
+
+    // Backwards so dropping a client only moves one we already handled
+    for (size_t i = count; i-- > 0;) {
+        StreamClient* client = &server->clients[i];
+        short events = pollfds[i + 1].revents;
+        bool alive = !(events & (POLLERR | POLLNVAL));
+
+        if (alive && (events & (POLLIN | POLLHUP))) {
+            alive = ReadClient(client, chip);
+        }
+        if (alive && (events & POLLOUT)) {
+            alive = WriteClient(client);
+        }
+        if (!alive) {
+            DropClient(server, i);
+        }
+    }
+
+    if (pollfds[0].revents & POLLIN) {
+        AcceptClients(server);
+    }
+}
+
+void CloseStreamServer(StreamServer* server) {
+    assert(server);
+    while (server->client_count > 0) {
+        DropClient(server, server->client_count - 1);
+    }
+
+    close(server->fd);
+    if (server->path) {
+        unlink(server->path);
+        free(server->path);
+    }
+
+    free(server->clients);
+    free(server->pollfds);
+    memset(server, 0, sizeof(StreamServer));
+}
@@ -0,0 +1,232 @@
+#include "terminal.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CELL_UNKNOWN 0xFFu
+
+// Indexed by cell, top pixel in bit 0 and bottom in bit 1
+static const char* const GLYPHS[4] = { " ", "\xE2\x96\x80", "\xE2\x96\x84", "\xE2\x96\x88" };
+static const size_t GLYPH_LENGTHS[4] = { 1, 3, 3, 3 };
+
+// Same layout as the window, see ProcessInput
+static const char KEYMAP[16] = { 'x', '1', '2', '3', 'q', 'w', 'e', 'a', 's', 'd', 'z', 'c', '4', 'r', 'f', 'v' };
+
+// Put back on exit, error() included, so the shell is not left in raw mode
+static Terminal* active = NULL;
+
+static uint64_t NowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void Append(Terminal* terminal, const char* data, size_t length) {
+    assert(terminal->out_length + length <= TERMINAL_BUFFER_SIZE);
+    memcpy(terminal->out + terminal->out_length, data, length);
+    terminal->out_length += length;
+}
+
+static void Flush(Terminal* terminal) {
+    size_t done = 0;
+    while (done < terminal->out_length) {
+        ssize_t sent = write(STDOUT_FILENO, terminal->out + done, terminal->out_length - done);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            break;
+        }
+        done += (size_t)sent;
+    }
+    terminal->out_length = 0;
+}
+
+// Park the cursor on the line under the screen so anything printed to stderr lands there
+static void Park(Terminal* terminal) {
+    char move[16];
+    int length = snprintf(move, sizeof(move), "\x1b[%u;1H", TERMINAL_ROWS + 1);
+    Append(terminal, move, (size_t)length);
+    terminal->row = TERMINAL_ROWS;
+    terminal->column = 0;
+}
+
+static void RestoreAtExit(void) {
+    if (active) {
+        CloseTerminal(active);
+    }
+}
+
+void OpenTerminal(Terminal* terminal) {
+    assert(terminal);
+    assert(!active);
+
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &terminal->saved) != 0) {
+        error("--terminal needs a terminal on stdin");
+    }
+
+    // No echo, no line editing, no signals from ctrl-c, reads return at once
+    struct termios raw = terminal->saved;
+    raw.c_lflag &= ~(tcflag_t)(ECHO | ICANON | ISIG | IEXTEN);
+    raw.c_iflag &= ~(tcflag_t)(IXON | ICRNL | BRKINT | INPCK | ISTRIP);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+        error("Could not switch the terminal to raw mode");
+    }
+
+    static bool registered = false;
+    if (!registered) {
+        atexit(RestoreAtExit);
+        registered = true;
+    }
+    active = terminal;
+
+    memset(terminal->cells, CELL_UNKNOWN, sizeof(terminal->cells));
+    memset(terminal->release, 0, sizeof(terminal->release));
+    terminal->out_length = 0;
+
+    // Hide the cursor and clear
+    static const char START[] = "\x1b[?25l\x1b[H\x1b[2J";
+    Append(terminal, START, sizeof(START) - 1);
+    Park(terminal);
+    Flush(terminal);
+}
+
+void CloseTerminal(Terminal* terminal) {
+    assert(terminal);
+    if (active != terminal) {
+        return;
+    }
+    active = NULL;
+
+    // The cursor is already parked under the screen, or under an error message
+    terminal->out_length = 0;
+    static const char SHOW[] = "\x1b[?25h";
+    Append(terminal, SHOW, sizeof(SHOW) - 1);
+    Flush(terminal);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &terminal->saved);
+}
+
+// Get the cursor to row, column with the fewest bytes, line is what that row shows now
+static void MoveTo(Terminal* terminal, uint8_t const* line, uint32_t row, uint32_t column) {
+    if (terminal->row == row && terminal->column == column) {
+        return;
+    }
+
+    char move[16];
+    int length = 0;
+    if (terminal->row == row && terminal->column < column) {
+        // Same line, compare stepping right with writing the unchanged cells again
+        size_t rewrite = 0;
+        for (uint32_t x = terminal->column; x < column; ++x) {
+            rewrite += GLYPH_LENGTHS[line[x]];
+        }
+        length = snprintf(move, sizeof(move), "\x1b[%uC", column - terminal->column);
+        if (rewrite <= (size_t)length) {
+            for (uint32_t x = terminal->column; x < column; ++x) {
+                Append(terminal, GLYPHS[line[x]], GLYPH_LENGTHS[line[x]]);
+            }
+            terminal->column = column;
+            return;
+        }
+    } else {
+        length = snprintf(move, sizeof(move), "\x1b[%u;%uH", row + 1, column + 1);
+    }
+
+    Append(terminal, move, (size_t)length);
+    terminal->row = row;
+    terminal->column = column;
+}
+
+void TerminalDraw(Terminal* terminal, Chip8 const* chip) {
+    assert(terminal && chip);
+
+    uint8_t cells[TERMINAL_ROWS][TERMINAL_COLUMNS];
+    for (uint32_t row = 0; row < TERMINAL_ROWS; ++row) {
+        uint32_t const* top = &chip->video[row * 2 * CHIP8_VIDEO_WIDTH];
+        uint32_t const* bottom = top + CHIP8_VIDEO_WIDTH;
+        for (uint32_t x = 0; x < TERMINAL_COLUMNS; ++x) {
+            cells[row][x] = (uint8_t)((top[x] & 0x1u) | ((bottom[x] & 0x1u) << 1));
+        }
+    }
+
+    bool changed = false;
+    for (uint32_t row = 0; row < TERMINAL_ROWS; ++row) {
+        for (uint32_t x = 0; x < TERMINAL_COLUMNS; ++x) {
+            uint8_t cell = cells[row][x];
+            if (terminal->cells[row][x] == cell) {
+                continue;
+            }
+            MoveTo(terminal, cells[row], row, x);
+            Append(terminal, GLYPHS[cell], GLYPH_LENGTHS[cell]);
+            terminal->cells[row][x] = cell;
+            terminal->column += 1;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        Park(terminal);
+        Flush(terminal);
+    }
+}
+
+bool TerminalInput(Terminal* terminal, uint8_t* keys, Hotkeys* hotkeys, Latency* latency) {
+    assert(terminal && keys && hotkeys);
+
+    bool quit = false;
+    uint64_t now = NowNs();
+
+    uint8_t input[64];
+    ssize_t length;
+    while ((length = read(STDIN_FILENO, input, sizeof(input))) > 0) {
+        for (ssize_t i = 0; i < length; ++i) {
+            uint8_t c = input[i];
+            if (c == 0x1b) {
+                // A lone escape is the key, anything after it is a sequence for a key we do not use
+                if (i + 1 == length) {
+                    quit = true;
+                } else if (input[i + 1] == '[' || input[i + 1] == 'O') {
+                    for (i += 2; i < length && (input[i] < 0x40 || input[i] > 0x7E); ++i) {
+                    }
+                }
+                continue;
+            }
+            if (c == 0x03) {
+                quit = true;
+            } else if (c == '\t') {
+                hotkeys->turbo = !hotkeys->turbo;
+            } else if (c == 0x0c) {
+                memset(terminal->cells, CELL_UNKNOWN, sizeof(terminal->cells));
+                static const char CLEAR[] = "\x1b[2J";
+                Append(terminal, CLEAR, sizeof(CLEAR) - 1);
+                Flush(terminal);
+            }
+
+            char lower = (char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+            for (uint32_t key = 0; key < 16; ++key) {
+                if (KEYMAP[key] == lower) {
+                    terminal->release[key] = now + TERMINAL_HOLD_MS * 1000000ull;
+                }
+            }
+        }
+    }
+
+    for (uint32_t key = 0; key < 16; ++key) {
+        uint8_t down = now < terminal->release[key];
+        if (keys[key] != down) {
+            keys[key] = down;
+            if (latency) {
+                LatencyKeyChanged(latency, key);
+            }
+        }
+    }
+    return quit;
+}
@@ -0,0 +1,92 @@
+#include "trace.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static void WriteU16(FILE* file, uint16_t value) {
+    fputc(value & 0xFFu, file);
+    fputc((value >> 8u) & 0xFFu, file);
+}
+
+static void WriteU32(FILE* file, uint32_t value) {
+    WriteU16(file, value & 0xFFFFu);
+    WriteU16(file, (value >> 16u) & 0xFFFFu);
+}
+
+static void DumpOnError(void* data) {
+    WriteTrace((Trace const*)data);
+}
+
+void OpenTrace(Trace* trace, const char* path, size_t capacity) {
+    assert(trace);
+    memset(trace, 0, sizeof(Trace));
+
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1u;
+    }
+
+    trace->records = calloc(size, sizeof(TraceRecord));
+    if (!trace->records) {
+        error("Could not allocate trace buffer");
+    }
+    trace->mask = size - 1;
+    trace->path = path;
+
+    SetErrorHandler(DumpOnError, trace);
+}
+
+void TraceEnd(TraceRecord* record, Chip8 const* chip, uint8_t const* before) {
+    record->index = chip->index;
+
+    for (uint8_t i = 0; i < 16; ++i) {
+        if (chip->registers[i] != before[i]) {
+            record->reg = i;
+            record->value = chip->registers[i];
+
+            // Keep looking past VF, it is usually just the flag
+            if (i != 0xF) {
+                break;
+            }
+        }
+    }
+}
+
+void WriteTrace(Trace const* trace) {
+    FILE* file = fopen(trace->path, "wb");
+    if (!file) {
+        fprintf(stderr, "[ERROR] Could not write trace to %s\n", trace->path);
+        return;
+    }
+
+    uint64_t size = trace->mask + 1;
+    uint64_t count = trace->head < size ? trace->head : size;
+
+    fwrite("CH8T", 1, 4, file);
+    WriteU32(file, sizeof(TraceRecord));
+    WriteU32(file, trace->head & 0xFFFFFFFFu);
+    WriteU32(file, trace->head >> 32u);
+    WriteU32(file, count);
+
+    for (uint64_t i = trace->head - count; i < trace->head; ++i) {
+        TraceRecord const* record = &trace->records[i & trace->mask];
+        WriteU16(file, record->pc);
+        WriteU16(file, record->opcode);
+        WriteU16(file, record->index);
+        fputc(record->reg, file);
+        fputc(record->value, file);
+    }
+
+    fclose(file);
+}
+
+void CloseTrace(Trace* trace) {
+    assert(trace);
+    SetErrorHandler(NULL, NULL);
+    WriteTrace(trace);
+    free(trace->records);
+    memset(trace, 0, sizeof(Trace));
+}
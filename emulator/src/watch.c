@@ -0,0 +1,124 @@
+#include "watch.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+static bool TestBit(uint64_t const* bitmap, uint16_t address) {
+    return (bitmap[address / 64] >> (address % 64)) & 0x1u;
+}
+
+static void SetBit(uint64_t* bitmap, uint16_t address) {
+    bitmap[address / 64] |= (uint64_t)1 << (address % 64);
+}
+
+static uint16_t PageBit(uint16_t address) {
+    return 1u << (address / WATCH_PAGE_SIZE);
+}
+
+static void Trigger(Watch* watch, Chip8 const* chip, uint16_t address, uint8_t kind) {
+    watch->triggered = true;
+    // The handlers run after the pc was advanced past the instruction
+    watch->hit.pc = chip->pc - 2;
+    watch->hit.address = address;
+    watch->hit.value = Chip8Peek(chip, address);
+    watch->hit.kind = kind;
+}
+
+void InitWatch(Watch* watch) {
+    assert(watch);
+    memset(watch, 0, sizeof(Watch));
+}
+
+void AddWatch(Watch* watch, uint16_t start, uint16_t end, unsigned kinds) {
+    for (uint32_t address = start; address <= end && address < CHIP8_MEMORY_SIZE; ++address) {
+        if (kinds & WATCH_READ) {
+            SetBit(watch->read, address);
+            watch->read_pages |= PageBit(address);
+        }
+        if (kinds & WATCH_WRITE) {
+            SetBit(watch->write, address);
+            watch->write_pages |= PageBit(address);
+        }
+    }
+}
+
+bool ParseWatchList(Watch* watch, const char* text) {
+    while (*text) {
+        unsigned kinds = 0;
+        for (; *text && *text != ':'; ++text) {
+            if (*text == 'r') {
+                kinds |= WATCH_READ;
+            } else if (*text == 'w') {
+                kinds |= WATCH_WRITE;
+            } else {
+                return false;
+            }
+        }
+        if (*text != ':' || kinds == 0) {
+            return false;
+        }
+
+        char* end = NULL;
+        unsigned long start = strtoul(text + 1, &end, 16);
+        unsigned long last = start;
+        if (end == text + 1) {
+            return false;
+        }
+        if (*end == '-') {
+            text = end + 1;
+            last = strtoul(text, &end, 16);
+            if (end == text) {
+                return false;
+            }
+        }
+        if (start > last || last >= CHIP8_MEMORY_SIZE) {
+            return false;
+        }
+
+        AddWatch(watch, start, last, kinds);
+
+        text = end;
+        if (*text == ',') {
+            ++text;
+        } else if (*text) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void WatchExecute(Watch* watch, uint16_t pc) {
+    pc %= CHIP8_MEMORY_SIZE;
+    SetBit(watch->code, pc);
+    SetBit(watch->code, (pc + 1) % CHIP8_MEMORY_SIZE);
+    watch->code_pages |= PageBit(pc) | PageBit((pc + 1) % CHIP8_MEMORY_SIZE);
+}
+
+void WatchRead(Watch* watch, Chip8 const* chip, uint16_t address) {
+    if ((watch->read_pages & PageBit(address)) && TestBit(watch->read, address)) {
+        Trigger(watch, chip, address, WATCH_READ);
+    }
+}
+
+void WatchWrite(Watch* watch, Chip8 const* chip, uint16_t address) {
+    uint16_t page = PageBit(address);
+
+    if ((watch->code_pages & page) && TestBit(watch->code, address)) {
+        watch->smc_writes += 1;
+        Trigger(watch, chip, address, WATCH_SMC);
+    } else if ((watch->write_pages & page) && TestBit(watch->write, address)) {
+        Trigger(watch, chip, address, WATCH_WRITE);
+    }
+}
+
+void PrintWatchHit(WatchHit const* hit) {
+    const char* kind = "read";
+    if (hit->kind == WATCH_WRITE) {
+        kind = "write";
+    } else if (hit->kind == WATCH_SMC) {
+        kind = "self modifying write";
+    }
+    fprintf(stderr, "[WATCH] %s of 0x%03X (now %02X) by pc 0x%03X\n", kind, hit->address, hit->value, hit->pc);
+}
@@ -0,0 +1,54 @@
+/*
+    Every opcode disassembles to text that assembles back to it, less the
+    fields the emulator ignores (see assembler.h)
+*/
+
+#include "assembler.h"
+#include "disassembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// The encoding the assembler gives back for opcode
+static uint16_t Canonical(uint16_t opcode) {
+    switch (opcode >> 12u) {
+        case 0x5:
+        case 0x9:
+            return opcode & 0xFFF0u;
+        case 0x8:
+            if ((opcode & 0x000Fu) == 0x6 || (opcode & 0x000Fu) == 0xE) {
+                return opcode & 0xFF0Fu;
+            }
+            return opcode;
+        default:
+            return opcode;
+    }
+}
+
+int main(void) {
+    uint32_t failures = 0;
+
+    for (uint32_t opcode = 0; opcode <= UINT16_MAX; ++opcode) {
+        char text[64];
+        Disassemble((uint16_t)opcode, text, sizeof(text));
+
+        uint8_t out[2] = { 0 };
+        size_t length = 0;
+        char message[128] = "";
+        bool ok = Assemble(text, out, sizeof(out), &length, message, sizeof(message));
+        uint16_t back = (uint16_t)((out[0] << 8u) | out[1]);
+        uint16_t expected = Canonical((uint16_t)opcode);
+        if (ok && length == 2 && back == expected) {
+            continue;
+        }
+
+        if (failures < 16) {
+            fprintf(stderr, "%04X \"%s\" -> %s %04X, expected %04X\n", (unsigned)opcode, text, ok ? "" : message,
+                    (unsigned)back, (unsigned)expected);
+        }
+        failures += 1;
+    }
+
+    printf("%u of 65536 opcodes did not round trip\n", (unsigned)failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
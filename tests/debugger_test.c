@@ -0,0 +1,84 @@
+/*
+    Breakpoints still hit once the pc has run past 0xFFF. BNNN and a fetch
+    at 0xFFE both leave it there until the next fetch wraps it, and the
+    bitmaps only cover 4K
+*/
+
+#include "debugger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT "debugger_test.in"
+#define START 0x200U
+
+typedef struct {
+    const char* name;
+    // Opcodes and where they go
+    uint16_t at[2];
+    uint16_t opcodes[2];
+    // Breakpoint command given at the first prompt
+    const char* breakpoint;
+    // Raw pc the debugger has to stop at
+    uint16_t expected_pc;
+} Case;
+
+static const Case CASES[] = {
+    { "BNNN past 0xFFF", { 0x200, 0x202 }, { 0x60FF, 0xBFFF }, "b 0fe v0 == ff", 0x10FE },
+    { "fetch at 0xFFE", { 0x200, 0xFFE }, { 0x1FFE, 0x6101 }, "b 000 v1 == 1", 0x1000 },
+};
+
+static bool Run(Case const* test) {
+    // Set the breakpoint, continue, quit at the break
+    FILE* input = fopen(INPUT, "w");
+    if (!input) {
+        fprintf(stderr, "Could not write %s\n", INPUT);
+        return false;
+    }
+    fprintf(input, "%s\nc\nq\n", test->breakpoint);
+    fclose(input);
+    if (!freopen(INPUT, "r", stdin)) {
+        fprintf(stderr, "Could not read %s\n", INPUT);
+        return false;
+    }
+
+    static uint8_t program[CHIP8_MEMORY_SIZE - START];
+    memset(program, 0, sizeof(program));
+    uint16_t size = 0;
+    for (size_t i = 0; i < 2; ++i) {
+        uint16_t offset = test->at[i] - START;
+        program[offset] = test->opcodes[i] >> 8u;
+        program[offset + 1] = test->opcodes[i] & 0xFFu;
+        size = offset + 2 > size ? offset + 2 : size;
+    }
+
+    static Chip8 chip;
+    Rom rom = { .memory = program, .name = "test", .rom_size = size };
+    Chip8Init(&chip);
+    Chip8LoadRom(&chip, &rom);
+
+    Debugger debugger;
+    InitDebugger(&debugger, true);
+
+    // Blank memory runs as CLS, the cap ends a run that missed its break
+    uint32_t cycles = 0;
+    while (cycles < 16 && DebuggerCycle(&debugger, &chip)) {
+        cycles += 1;
+    }
+    Chip8Release(&chip);
+
+    bool ok = chip.pc == test->expected_pc;
+    printf("%s: stopped at %04X after %u instructions, expected %04X\n", test->name, (unsigned)chip.pc,
+           (unsigned)cycles, (unsigned)test->expected_pc);
+    return ok;
+}
+
+int main(void) {
+    uint32_t failures = 0;
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); ++i) {
+        failures += !Run(&CASES[i]);
+    }
+    remove(INPUT);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
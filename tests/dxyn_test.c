@@ -0,0 +1,95 @@
+/*
+    DXYN clips a sprite at the right and bottom edges on both axes, only its
+    start wraps. A draw in the corner touches that one pixel and leaves the
+    rest of the screen and the fields around the framebuffer alone
+*/
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define START 0x200U
+#define SPRITE 0x300U
+
+typedef struct {
+    const char* name;
+    // Where the sprite is drawn, before the start wraps
+    uint8_t x;
+    uint8_t y;
+    uint8_t height;
+    // Pixels that have to be on afterwards
+    uint16_t on[4];
+    size_t on_count;
+} Case;
+
+static const Case CASES[] = {
+    { "corner", 63, 31, 1, { 31 * 64 + 63 }, 1 },
+    { "past the corner", 63, 31, 15, { 31 * 64 + 63 }, 1 },
+    { "right edge", 62, 0, 2, { 62, 63, 64 + 62, 64 + 63 }, 4 },
+    { "wrapped start", 64 + 63, 32 + 31, 1, { 31 * 64 + 63 }, 1 },
+};
+
+static bool Run(Case const* test) {
+    // LD V0,x  LD V1,y  LD I,SPRITE  DRW V0,V1,n  over a sprite of full rows
+    static uint8_t program[CHIP8_MEMORY_SIZE - START];
+    memset(program, 0, sizeof(program));
+    uint16_t const opcodes[] = {
+        0x6000u | test->x, 0x6100u | test->y, 0xA000u | SPRITE, 0xD010u | test->height,
+    };
+    for (size_t i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); ++i) {
+        program[i * 2] = opcodes[i] >> 8u;
+        program[i * 2 + 1] = opcodes[i] & 0xFFu;
+    }
+    memset(&program[SPRITE - START], 0xFF, 16);
+
+    static Chip8 chip;
+    Rom rom = { .memory = program, .name = "test", .rom_size = SPRITE - START + 16 };
+    Chip8Init(&chip);
+    Chip8LoadRom(&chip, &rom);
+
+    Chip8 before = chip;
+    for (size_t i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); ++i) {
+        Chip8Cycle(&chip);
+    }
+
+    bool ok = true;
+    size_t lit = 0;
+    for (size_t pixel = 0; pixel < CHIP8_VIDEO_SIZE; ++pixel) {
+        bool expected = false;
+        for (size_t i = 0; i < test->on_count; ++i) {
+            expected |= test->on[i] == pixel;
+        }
+        lit += chip.video[pixel] != 0;
+        if ((chip.video[pixel] == 0xFFFFFFFFu) != expected) {
+            printf("%s: pixel (%u,%u) is %08X\n", test->name, (unsigned)(pixel % CHIP8_VIDEO_WIDTH),
+                   (unsigned)(pixel / CHIP8_VIDEO_WIDTH), (unsigned)chip.video[pixel]);
+            ok = false;
+        }
+    }
+
+    // Nothing outside the framebuffer was written
+    if (chip.rng != before.rng || chip.rom != before.rom || chip.watch != before.watch ||
+        chip.keys_read != before.keys_read || memcmp(chip.keypad, before.keypad, sizeof(chip.keypad)) != 0) {
+        printf("%s: fields around the framebuffer changed\n", test->name);
+        ok = false;
+    }
+    if (chip.registers[0xF] != 0) {
+        printf("%s: collision on a blank screen\n", test->name);
+        ok = false;
+    }
+    Chip8Release(&chip);
+
+    printf("%s: %u pixels on, expected %u\n", test->name, (unsigned)lit, (unsigned)test->on_count);
+    return ok;
+}
+
+int main(void) {
+    uint32_t failures = 0;
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); ++i) {
+        failures += !Run(&CASES[i]);
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+/*
+    chippy-asm, assemble CHIP-8 mnemonics into a rom
+
+    Usage: chippy-asm <source> <rom>
+
+    Takes the syntax described in assembler.h, which is also what chippy-trace
+    and the debugger print.
+*/
+
+#include "assembler.h"
+#include "chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char* USAGE = "Usage: chippy-asm <source> <rom>\n";
+
+static int Fail(const char* msg) {
+    fprintf(stderr, "[ERROR] %s\n", msg);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) {
+        return Fail("Could not open source");
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* source = size >= 0 ? malloc(size + 1) : NULL;
+    if (!source || fread(source, 1, size, file) != (size_t)size) {
+        fclose(file);
+        free(source);
+        return Fail("Could not read source");
+    }
+    source[size] = '\0';
+    fclose(file);
+
+    uint8_t rom[CHIP8_MEMORY_SIZE - 0x200];
+    size_t length = 0;
+    char message[128];
+    bool ok = Assemble(source, rom, sizeof(rom), &length, message, sizeof(message));
+    free(source);
+    if (!ok) {
+        fprintf(stderr, "[ERROR] %s: %s\n", argv[1], message);
+        return EXIT_FAILURE;
+    }
+
+    file = fopen(argv[2], "wb");
+    if (!file || fwrite(rom, 1, length, file) != length) {
+        if (file) {
+            fclose(file);
+        }
+        return Fail("Could not write rom");
+    }
+    fclose(file);
+
+    printf("%s: %zu bytes\n", argv[2], length);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,748 @@
+/*
+    chippy-bench, synthetic roms that each lean on one hot path of chip8.c
+
+    Usage: chippy-bench [--kind=NAME] [--scale=N] [--repeat=N] [--out=DIR] [--perf]
+        --kind=NAME  draw, alu, call, memory, selfmod or all (default all)
+        --scale=N    outer loop count of every rom, 1-255 (default 255)
+        --repeat=N   timed runs per engine, the best is reported (default 10)
+        --out=DIR    also write NAME.s, NAME.ch8 and NAME.expect there
+        --perf       host cycles, instructions, branch and cache misses per
+                     emulated instruction from hardware counters (Linux only)
+
+    Every rom is written as assembly, goes through the assembler and ends on
+    "halt: JP halt". Its expected final state comes from a plain C model of the
+    same program rather than from the emulator. Chip8Cycle and Chip8Run both
+    have to end in that state, Chip8Cycle also in the model's instruction count.
+
+    With --perf each engine gets one more run with the counters read around
+    it, then Chip8Cycle runs again with a read after every instruction so the
+    counts can be split by opcode class (the top nibble). The average cost of
+    a read on its own is taken off each instruction, so expect those rows to
+    be a little noisy where the real cost is close to zero.
+*/
+
+#include "assembler.h"
+#include "chip8.h"
+#include "rom.h"
+#if defined(CHIPPY_PERF)
+#include "perf.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char* USAGE = "Usage: chippy-bench [--kind=NAME] [--scale=N] [--repeat=N] [--out=DIR] [--perf]\n";
+
+// Where the memory sweep works, well clear of the generated code
+#define BENCH_BUFFER 0x800U
+#define BENCH_BUFFER_SIZE 256U
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} Text;
+
+typedef struct {
+    uint8_t registers[16];
+    // Bit n set checks Vn
+    uint16_t checked;
+    uint16_t index;
+    bool index_checked;
+    // Pixels left on
+    uint32_t lit;
+    // Up to and not including the final JP halt
+    uint64_t instructions;
+    uint16_t memory_size;
+    uint8_t memory[BENCH_BUFFER_SIZE];
+} Expected;
+
+typedef void (*Generator)(Text* text, uint8_t scale, Expected* expected);
+
+static void Line(Text* text, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (text->length + needed + 2 > text->capacity) {
+        text->capacity = (text->length + needed + 2) * 2;
+        text->data = realloc(text->data, text->capacity);
+        if (!text->data) {
+            fputs("[ERROR] Out of memory\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    va_start(args, format);
+    vsnprintf(text->data + text->length, needed + 1, format, args);
+    va_end(args);
+    text->length += needed;
+    text->data[text->length++] = '\n';
+    text->data[text->length] = '\0';
+}
+
+// The model follows chip8.c, VF is written before the result
+static void Add(uint8_t* v, int x, uint8_t value) {
+    unsigned sum = v[x] + value;
+    v[0xF] = sum > 0xFF;
+    v[x] = sum & 0xFF;
+}
+
+static void Sub(uint8_t* v, int x, int y) {
+    v[0xF] = v[x] > v[y];
+    v[x] = v[x] - v[y];
+}
+
+static void Shl(uint8_t* v, int x) {
+    v[0xF] = v[x] >> 7;
+    v[x] = v[x] << 1;
+}
+
+static uint32_t Bits(uint8_t const* bytes, size_t count) {
+    uint32_t bits = 0;
+    for (size_t i = 0; i < count; ++i) {
+        for (uint8_t byte = bytes[i]; byte; byte &= byte - 1) {
+            bits += 1;
+        }
+    }
+    return bits;
+}
+
+/* DXYN storms, every sprite is drawn twice per pass so each pass leaves the screen blank */
+static void Draw(Text* s, uint8_t scale, Expected* e) {
+    static const uint8_t A[8] = { 0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF };
+    static const uint8_t B[8] = { 0x3C, 0x42, 0x81, 0x99, 0x99, 0x81, 0x42, 0x3C };
+
+    Line(s, "; draw, %u passes of 72 sprites on a 6x3 grid", scale);
+    Line(s, "    CLS");
+    Line(s, "    LD V2, %u", scale);
+    Line(s, "pass:");
+    Line(s, "    LD V1, 1");
+    Line(s, "row:");
+    Line(s, "    LD V0, 1");
+    Line(s, "col:");
+    for (int i = 0; i < 4; ++i) {
+        Line(s, "    LD I, %s", i % 2 ? "sprite_b" : "sprite_a");
+        Line(s, "    DRW V0, V1, 8");
+    }
+    Line(s, "    ADD V0, 9");
+    Line(s, "    SE V0, 55");
+    Line(s, "    JP col");
+    Line(s, "    ADD V1, 9");
+    Line(s, "    SE V1, 28");
+    Line(s, "    JP row");
+    Line(s, "    ADD V2, -1");
+    Line(s, "    SE V2, 0");
+    Line(s, "    JP pass");
+    Line(s, "; one sprite left over, VF clear only if everything before was erased");
+    Line(s, "    LD V0, 28");
+    Line(s, "    LD V1, 12");
+    Line(s, "    LD I, sprite_a");
+    Line(s, "    DRW V0, V1, 8");
+    Line(s, "halt:");
+    Line(s, "    JP halt");
+    Line(s, "sprite_a:");
+    Line(s, "    DB 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X", A[0], A[1], A[2], A[3], A[4], A[5],
+         A[6], A[7]);
+    Line(s, "sprite_b:");
+    Line(s, "    DB 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X", B[0], B[1], B[2], B[3], B[4], B[5],
+         B[6], B[7]);
+
+    uint8_t* v = e->registers;
+    uint64_t n = 2;
+    v[2] = scale;
+    do {
+        v[1] = 1;
+        n += 1;
+        do {
+            v[0] = 1;
+            n += 1;
+            do {
+                v[0] += 9;
+                n += 10 + (v[0] != 55);
+            } while (v[0] != 55);
+            v[1] += 9;
+            n += 2 + (v[1] != 28);
+        } while (v[1] != 28);
+        v[2] -= 1;
+        n += 2 + (v[2] != 0);
+    } while (v[2] != 0);
+    v[0] = 28;
+    v[1] = 12;
+    v[0xF] = 0;
+    n += 4;
+
+    e->checked = 0xFFFF;
+    e->lit = Bits(A, sizeof(A));
+    e->instructions = n;
+}
+
+/* Arithmetic, carries and skips in a tight loop, then a counted spin */
+static void Alu(Text* s, uint8_t scale, Expected* e) {
+    Line(s, "; alu, %u passes of 200", scale);
+    Line(s, "    LD V0, 0");
+    Line(s, "    LD V1, 0");
+    Line(s, "    LD V2, %u", scale);
+    Line(s, "    LD V7, 0");
+    Line(s, "    LD V8, 0");
+    Line(s, "    LD V9, 0");
+    Line(s, "outer:");
+    Line(s, "    LD V3, 0");
+    Line(s, "inner:");
+    Line(s, "    ADD V0, V3");
+    Line(s, "    ADD V7, VF");
+    Line(s, "    XOR V1, V0");
+    Line(s, "    LD V4, V1");
+    Line(s, "    SHL V4");
+    Line(s, "    ADD V8, VF");
+    Line(s, "    AND V4, V2");
+    Line(s, "    ADD V1, V4");
+    Line(s, "    SE V0, V1");
+    Line(s, "    ADD V9, 1");
+    Line(s, "    ADD V3, 1");
+    Line(s, "    SE V3, 200");
+    Line(s, "    JP inner");
+    Line(s, "    LD V6, 1");
+    Line(s, "    SUB V2, V6");
+    Line(s, "    SE V2, 0");
+    Line(s, "    JP outer");
+    Line(s, "    LD V5, 0");
+    Line(s, "spin:");
+    Line(s, "    ADD V5, 1");
+    Line(s, "    SE V5, 0");
+    Line(s, "    JP spin");
+    Line(s, "halt:");
+    Line(s, "    JP halt");
+
+    uint8_t* v = e->registers;
+    uint64_t n = 6;
+    v[2] = scale;
+    do {
+        v[3] = 0;
+        n += 1;
+        do {
+            Add(v, 0, v[3]);
+            Add(v, 7, v[0xF]);
+            v[1] ^= v[0];
+            v[4] = v[1];
+            Shl(v, 4);
+            Add(v, 8, v[0xF]);
+            v[4] &= v[2];
+            Add(v, 1, v[4]);
+            n += 9;
+            if (v[0] != v[1]) {
+                v[9] += 1;
+                n += 1;
+            }
+            v[3] += 1;
+            n += 2 + (v[3] != 200);
+        } while (v[3] != 200);
+        v[6] = 1;
+        Sub(v, 2, 6);
+        n += 3 + (v[2] != 0);
+    } while (v[2] != 0);
+    v[5] = 0;
+    n += 1;
+    do {
+        v[5] += 1;
+        n += 2 + (v[5] != 0);
+    } while (v[5] != 0);
+
+    e->checked = 0xFFFF;
+    e->instructions = n;
+}
+
+/* Recursion 15 calls deep, one slot short of the 16 entry stack */
+static void Call(Text* s, uint8_t scale, Expected* e) {
+    Line(s, "; call, %u descents of depth 15", scale);
+    Line(s, "    LD V2, %u", scale);
+    Line(s, "again:");
+    Line(s, "    LD V0, 15");
+    Line(s, "    LD V1, 0");
+    Line(s, "    CALL down");
+    Line(s, "    ADD V2, -1");
+    Line(s, "    SE V2, 0");
+    Line(s, "    JP again");
+    Line(s, "    JP halt");
+    Line(s, "down:");
+    Line(s, "    ADD V1, 1");
+    Line(s, "    ADD V0, -1");
+    Line(s, "    SE V0, 0");
+    Line(s, "    CALL down");
+    Line(s, "    ADD V3, V1");
+    Line(s, "    RET");
+    Line(s, "halt:");
+    Line(s, "    JP halt");
+
+    uint8_t* v = e->registers;
+    uint64_t n = 1;
+    v[2] = scale;
+    do {
+        v[0] = 15;
+        v[1] = 0;
+        n += 3;
+        int depth = 0;
+        do {
+            v[1] += 1;
+            v[0] -= 1;
+            depth += 1;
+            n += 3 + (v[0] != 0);
+        } while (v[0] != 0);
+        for (int i = 0; i < depth; ++i) {
+            Add(v, 3, v[1]);
+            n += 2;
+        }
+        v[2] -= 1;
+        n += 2 + (v[2] != 0);
+    } while (v[2] != 0);
+    n += 1;
+
+    e->checked = 0xFFFF;
+    e->instructions = n;
+}
+
+/* FX65 and FX55 over a 256 byte buffer 4 registers at a time, I stepped by FX1E */
+static void Memory(Text* s, uint8_t scale, Expected* e) {
+    Line(s, "; memory, %u sweeps over 0x%03X-0x%03X", scale, BENCH_BUFFER, BENCH_BUFFER + BENCH_BUFFER_SIZE - 1);
+    Line(s, "    LD V4, %u", scale);
+    Line(s, "pass:");
+    Line(s, "    LD I, 0x%03X", BENCH_BUFFER);
+    Line(s, "    LD V5, 0");
+    Line(s, "    LD V6, 4");
+    Line(s, "sweep:");
+    Line(s, "    LD V3, [I]");
+    Line(s, "    ADD V0, 1");
+    Line(s, "    ADD V1, V0");
+    Line(s, "    ADD V2, 3");
+    Line(s, "    XOR V3, V1");
+    Line(s, "    LD [I], V3");
+    Line(s, "    ADD I, V6");
+    Line(s, "    ADD V5, 1");
+    Line(s, "    SE V5, %u", BENCH_BUFFER_SIZE / 4);
+    Line(s, "    JP sweep");
+    Line(s, "    ADD V4, -1");
+    Line(s, "    SE V4, 0");
+    Line(s, "    JP pass");
+    Line(s, "halt:");
+    Line(s, "    JP halt");
+
+    uint8_t* v = e->registers;
+    uint8_t* memory = e->memory;
+    uint64_t n = 1;
+    v[4] = scale;
+    do {
+        v[5] = 0;
+        v[6] = 4;
+        n += 3;
+        for (uint32_t at = 0; at < BENCH_BUFFER_SIZE; at += 4) {
+            memcpy(v, memory + at, 4);
+            v[0] += 1;
+            Add(v, 1, v[0]);
+            v[2] += 3;
+            v[3] ^= v[1];
+            memcpy(memory + at, v, 4);
+            v[5] += 1;
+            n += 9 + (v[5] != BENCH_BUFFER_SIZE / 4);
+        }
+        v[4] -= 1;
+        n += 2 + (v[4] != 0);
+    } while (v[4] != 0);
+
+    e->checked = 0xFFFF;
+    e->index = BENCH_BUFFER + BENCH_BUFFER_SIZE;
+    e->index_checked = true;
+    e->memory_size = BENCH_BUFFER_SIZE;
+    e->instructions = n;
+}
+
+/* FX55 rewrites immediates under a counted loop Chip8Run fuses, and under a plain ADD */
+static void SelfModify(Text* s, uint8_t scale, Expected* e) {
+    Line(s, "; selfmod, %u patches of two immediates", scale);
+    Line(s, "    LD V1, 0");
+    Line(s, "    LD V2, %u", scale);
+    Line(s, "    LD V3, 0");
+    Line(s, "step:");
+    Line(s, "    ADD V1, 0");
+    Line(s, "    SE V1, 0");
+    Line(s, "    JP step");
+    Line(s, "sum:");
+    Line(s, "    ADD V5, 0");
+    Line(s, "    ADD V3, 1");
+    Line(s, "    LD I, step+1");
+    Line(s, "    LD V0, [I]");
+    Line(s, "    ADD V0, 1");
+    Line(s, "    LD [I], V0");
+    Line(s, "    LD I, sum+1");
+    Line(s, "    LD [I], V0");
+    Line(s, "    ADD V2, -1");
+    Line(s, "    SE V2, 0");
+    Line(s, "    JP step");
+    Line(s, "halt:");
+    Line(s, "    JP halt");
+
+    uint8_t* v = e->registers;
+    uint8_t step = 0;
+    uint64_t n = 3;
+    v[2] = scale;
+    do {
+        do {
+            v[1] += step;
+            n += 2 + (v[1] != 0);
+        } while (v[1] != 0);
+        v[5] += step;
+        v[3] += 1;
+        v[0] = step + 1;
+        step = v[0];
+        v[2] -= 1;
+        n += 10 + (v[2] != 0);
+    } while (v[2] != 0);
+
+    e->checked = 0xFFFF;
+    e->instructions = n;
+}
+
+static const struct {
+    const char* name;
+    Generator generate;
+} KINDS[] = {
+    { "draw", Draw }, { "alu", Alu }, { "call", Call }, { "memory", Memory }, { "selfmod", SelfModify }
+};
+
+static bool AtHalt(Chip8 const* chip) {
+    uint16_t pc = chip->pc & (CHIP8_MEMORY_SIZE - 1);
+    uint16_t opcode = (Chip8Peek(chip, pc) << 8u) | Chip8Peek(chip, pc + 1);
+    return opcode == (0x1000u | pc);
+}
+
+static void Boot(Chip8* chip, uint8_t* program, size_t length) {
+    Rom rom = { .memory = program, .name = "bench", .rom_size = (uint16_t)length };
+    Chip8Release(chip);
+    Chip8Init(chip);
+    Chip8Seed(chip, 1);
+    Chip8LoadRom(chip, &rom);
+}
+
+static double Now(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Run to the halt, returns the instructions counted by the engine
+static uint64_t RunEngine(Chip8* chip, bool fused, uint64_t limit) {
+    uint64_t executed = 0;
+    if (fused) {
+        while (!AtHalt(chip) && executed < limit) {
+            executed += Chip8Run(chip, 4096);
+        }
+        return executed;
+    }
+
+    // In these roms only the halt leaves the pc where it was, it is not counted
+    while (executed < limit) {
+        uint16_t pc = chip->pc;
+        Chip8Cycle(chip);
+        if (chip->pc == pc) {
+            break;
+        }
+        executed += 1;
+    }
+    return executed;
+}
+
+static bool Check(Chip8 const* chip, Expected const* e, char* why, size_t size) {
+    if (!AtHalt(chip)) {
+        snprintf(why, size, "did not reach the halt, pc=%03X", chip->pc);
+        return false;
+    }
+    for (int i = 0; i < 16; ++i) {
+        if ((e->checked >> i) & 1u && chip->registers[i] != e->registers[i]) {
+            snprintf(why, size, "V%X=%02X, expected %02X", i, chip->registers[i], e->registers[i]);
+            return false;
+        }
+    }
+    if (chip->sp != 0) {
+        snprintf(why, size, "sp=%u, expected 0", chip->sp);
+        return false;
+    }
+    if (e->index_checked && chip->index != e->index) {
+        snprintf(why, size, "I=%03X, expected %03X", chip->index, e->index);
+        return false;
+    }
+
+    uint32_t lit = 0;
+    for (uint32_t i = 0; i < CHIP8_VIDEO_SIZE; ++i) {
+        lit += chip->video[i] != 0;
+    }
+    if (lit != e->lit) {
+        snprintf(why, size, "%u pixels on, expected %u", lit, e->lit);
+        return false;
+    }
+    for (uint16_t i = 0; i < e->memory_size; ++i) {
+        if (Chip8Peek(chip, BENCH_BUFFER + i) != e->memory[i]) {
+            snprintf(why, size, "memory at 0x%03X differs", BENCH_BUFFER + i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool WriteFile(const char* dir, const char* name, const char* extension, void const* data, size_t size) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.%s", dir, name, extension);
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+static bool WriteExpected(const char* dir, const char* name, uint8_t scale, Expected const* e) {
+    Text text = { 0 };
+    Line(&text, "; chippy-bench %s scale=%u, state at the final JP halt", name, scale);
+    Line(&text, "instructions=%llu", (unsigned long long)e->instructions);
+    for (int i = 0; i < 16; ++i) {
+        if ((e->checked >> i) & 1u) {
+            Line(&text, "V%X=0x%02X", i, e->registers[i]);
+        }
+    }
+    if (e->index_checked) {
+        Line(&text, "I=0x%03X", e->index);
+    }
+    Line(&text, "sp=0");
+    Line(&text, "lit=%u", e->lit);
+    for (uint32_t at = 0; at < e->memory_size; at += 16) {
+        char row[64];
+        for (uint32_t i = 0; i < 16; ++i) {
+            snprintf(row + i * 3, sizeof(row) - i * 3, "%02X ", e->memory[at + i]);
+        }
+        row[47] = '\0';
+        Line(&text, "mem 0x%03X %s", BENCH_BUFFER + at, row);
+    }
+
+    bool ok = WriteFile(dir, name, "expect", text.data, text.length);
+    free(text.data);
+    return ok;
+}
+
+#if defined(CHIPPY_PERF)
+static const char* CLASSES[16] = {
+    "0 cls/ret", "1 jp", "2 call", "3 se kk", "4 sne kk", "5 se xy", "6 ld kk", "7 add kk",
+    "8 alu", "9 sne xy", "a ld i", "b jp v0", "c rnd", "d drw", "e skp", "f misc"
+};
+
+static void PrintCounterHeader(void) {
+    printf("  %-10s %10s", "", "count");
+    for (int c = 0; c < PERF_COUNTERS; ++c) {
+        printf(" %13s", PerfName(c));
+    }
+    putchar('\n');
+}
+
+static void PrintCounters(Perf const* perf, const char* label, uint64_t count, int64_t const* totals, bool counted) {
+    printf("  %-10s %10llu", label, (unsigned long long)count);
+    for (int c = 0; c < PERF_COUNTERS; ++c) {
+        if (counted && PerfHas(perf, c) && count) {
+            printf(" %13.3f", (double)totals[c] / count);
+        } else {
+            printf(" %13s", "n/a");
+        }
+    }
+    putchar('\n');
+}
+
+static void CountEngine(Perf const* perf, Chip8* chip, uint8_t* program, size_t length, bool fused, uint64_t instructions) {
+    PerfSample before;
+    PerfSample after;
+    Boot(chip, program, length);
+    bool counted = PerfRead(perf, &before);
+    RunEngine(chip, fused, instructions * 2 + 4096);
+    counted = PerfRead(perf, &after) && counted;
+
+    int64_t totals[PERF_COUNTERS];
+    for (int c = 0; c < PERF_COUNTERS; ++c) {
+        totals[c] = (int64_t)(after.values[c] - before.values[c]);
+    }
+    PrintCounters(perf, fused ? "run" : "cycle", instructions, totals, counted);
+}
+
+// Chip8Cycle with a read after every instruction, charged to its opcode class
+static void CountClasses(Perf const* perf, Chip8* chip, uint8_t* program, size_t length, uint64_t limit) {
+    enum { OVERHEAD_READS = 1024 };
+    PerfSample before;
+    PerfSample after;
+
+    // Average of back to back reads, what every instruction below pays on top
+    int64_t overhead[PERF_COUNTERS] = { 0 };
+    bool counted = PerfRead(perf, &before);
+    for (int i = 0; i < OVERHEAD_READS; ++i) {
+        counted = PerfRead(perf, &after) && counted;
+        for (int c = 0; c < PERF_COUNTERS; ++c) {
+            overhead[c] += (int64_t)(after.values[c] - before.values[c]);
+        }
+        before = after;
+    }
+    for (int c = 0; c < PERF_COUNTERS; ++c) {
+        overhead[c] /= OVERHEAD_READS;
+    }
+
+    int64_t totals[16][PERF_COUNTERS] = { { 0 } };
+    uint64_t counts[16] = { 0 };
+    Boot(chip, program, length);
+    counted = PerfRead(perf, &before) && counted;
+    for (uint64_t n = 0; n < limit; ++n) {
+        uint16_t pc = chip->pc;
+        uint8_t class = Chip8Peek(chip, pc) >> 4u;
+        Chip8Cycle(chip);
+        counted = PerfRead(perf, &after) && counted;
+        if (chip->pc == pc) {
+            break;
+        }
+
+        counts[class] += 1;
+        for (int c = 0; c < PERF_COUNTERS; ++c) {
+            totals[class][c] += (int64_t)(after.values[c] - before.values[c]) - overhead[c];
+        }
+        before = after;
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        if (counts[i]) {
+            PrintCounters(perf, CLASSES[i], counts[i], totals[i], counted);
+        }
+    }
+}
+#endif
+
+int main(int argc, char** argv) {
+    const char* kind = "all";
+    unsigned long scale = 255;
+    unsigned long repeat = 10;
+    const char* out = NULL;
+    bool perf_wanted = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--kind=", 7) == 0) {
+            kind = argv[i] + 7;
+        } else if (strncmp(argv[i], "--scale=", 8) == 0) {
+            scale = strtoul(argv[i] + 8, NULL, 10);
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            repeat = strtoul(argv[i] + 9, NULL, 10);
+        } else if (strncmp(argv[i], "--out=", 6) == 0) {
+            out = argv[i] + 6;
+#if defined(CHIPPY_PERF)
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            perf_wanted = true;
+#endif
+        } else {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    if (scale < 1 || scale > 255 || repeat < 1) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+
+    Chip8* chip = calloc(1, sizeof(Chip8));
+    if (!chip) {
+        fputs("[ERROR] Out of memory\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+#if defined(CHIPPY_PERF)
+    Perf perf;
+    bool counting = perf_wanted && OpenPerf(&perf);
+    if (perf_wanted && !counting) {
+        fputs("[PERF] No hardware counters, check perf_event_paranoid or run on bare metal\n", stderr);
+    }
+#else
+    (void)perf_wanted;
+#endif
+
+    bool matched = false;
+    bool passed = true;
+    for (size_t k = 0; k < sizeof(KINDS) / sizeof(KINDS[0]); ++k) {
+        if (strcmp(kind, "all") != 0 && strcmp(kind, KINDS[k].name) != 0) {
+            continue;
+        }
+        matched = true;
+
+        Text source = { 0 };
+        Expected expected = { 0 };
+        KINDS[k].generate(&source, (uint8_t)scale, &expected);
+
+        uint8_t program[CHIP8_MEMORY_SIZE - 0x200];
+        size_t length = 0;
+        char message[128];
+        if (!Assemble(source.data, program, sizeof(program), &length, message, sizeof(message))) {
+            fprintf(stderr, "[ERROR] %s: %s\n", KINDS[k].name, message);
+            return EXIT_FAILURE;
+        }
+
+        if (out && !(WriteFile(out, KINDS[k].name, "s", source.data, source.length) &&
+                     WriteFile(out, KINDS[k].name, "ch8", program, length) &&
+                     WriteExpected(out, KINDS[k].name, (uint8_t)scale, &expected))) {
+            fprintf(stderr, "[ERROR] Could not write %s files to %s\n", KINDS[k].name, out);
+            return EXIT_FAILURE;
+        }
+        free(source.data);
+
+        printf("%-8s %10llu instructions", KINDS[k].name, (unsigned long long)expected.instructions);
+        for (int fused = 0; fused <= 1; ++fused) {
+            double best = 0.0;
+            uint64_t executed = 0;
+            for (unsigned long r = 0; r < repeat; ++r) {
+                Boot(chip, program, length);
+                double start = Now();
+                executed = RunEngine(chip, fused, expected.instructions * 2 + 4096);
+                double elapsed = Now() - start;
+                best = (r == 0 || elapsed < best) ? elapsed : best;
+            }
+
+            // Chip8Run also counts the halt it burns through, only Chip8Cycle counts exactly
+            char why[96];
+            bool ok = Check(chip, &expected, why, sizeof(why));
+            if (ok && !fused && executed != expected.instructions) {
+                snprintf(why, sizeof(why), "%llu instructions", (unsigned long long)executed);
+                ok = false;
+            }
+            passed = passed && ok;
+
+            double mips = best > 0.0 ? expected.instructions / best / 1e6 : 0.0;
+            printf("  %s %8.1f MIPS %s", fused ? "run" : "cycle", mips, ok ? "PASS" : "FAIL");
+            if (!ok) {
+                printf(" (%s)", why);
+            }
+        }
+        putchar('\n');
+
+#if defined(CHIPPY_PERF)
+        if (counting) {
+            PrintCounterHeader();
+            CountEngine(&perf, chip, program, length, false, expected.instructions);
+            CountEngine(&perf, chip, program, length, true, expected.instructions);
+            CountClasses(&perf, chip, program, length, expected.instructions * 2 + 4096);
+        }
+#endif
+    }
+
+#if defined(CHIPPY_PERF)
+    if (counting) {
+        ClosePerf(&perf);
+    }
+#endif
+    Chip8Release(chip);
+    free(chip);
+    if (!matched) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
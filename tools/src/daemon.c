@@ -0,0 +1,799 @@
+/*
+    chippyd, many independent chip8 sessions in one process behind a unix socket
+
+    Usage: chippyd [--socket=PATH] [--threads=N] [--max-sessions=N]
+        --socket=PATH     listen here (default /tmp/chippyd.sock)
+        --threads=N       stepping threads (default one per core)
+        --max-sessions=N  session arena size (default 1024, at most 65535)
+
+    Requests and responses are a 9 byte header and a payload, little endian:
+        request   u8 op u32 session u32 length, length bytes
+        response  u8 status u32 session u32 length, length bytes
+
+    op   request payload               response payload
+    'C'  u32 seed, rom                 -           new session, the id is in the header
+    'S'  u32 frames u32 ipf u16 keys   u64 state hash, 1bpp frame (CHIP8_VIDEO_BYTES)
+    'K'  u16 keys                      -
+    'G'  -                             Chip8State  snapshot, native layout
+    'P'  Chip8State                    -           restore, also clears a fault
+    'V'  -                             1bpp frame
+    'D'  -                             -
+
+    A step of more than DAEMON_MAX_STEP instructions (frames times ipf) is a
+    bad request. Status is one of the DaemonStatus values below. Requests on a connection
+    are answered in order. Sessions belong to the connection that created
+    them and go away with it.
+
+    One thread runs an epoll loop over every connection and does the cheap
+    requests inline. Steps go to a pool of threads, at most one per
+    connection at a time, and come back through an eventfd. Sessions live in
+    one arena allocated up front with a free list. Sessions of the same rom
+    run from one shared read only image and only take the pages they write
+    from a pool, so creating one is a Chip8Init and a lookup. A session that hits a bad
+    opcode is marked faulted instead of taking the daemon down.
+*/
+
+#include "chip8.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+static const char* USAGE = "Usage: chippyd [--socket=PATH] [--threads=N] [--max-sessions=N]\n";
+
+#define DAEMON_MAX_CLIENTS 1024U
+#define DAEMON_HEADER_SIZE 9U
+#define DAEMON_MAX_REQUEST (DAEMON_HEADER_SIZE + sizeof(Chip8State))
+// A client that stops reading is dropped once this much is queued for it
+#define DAEMON_MAX_OUTPUT (1U << 20U)
+#define DAEMON_MAX_THREADS 64U
+// Instructions one step may ask for, frames times ipf, so a request cannot hold a worker for long
+#define DAEMON_MAX_STEP (1U << 24U)
+
+// epoll tags besides client indices
+#define TAG_LISTEN (DAEMON_MAX_CLIENTS)
+#define TAG_WAKE (DAEMON_MAX_CLIENTS + 1U)
+
+typedef enum {
+    STATUS_OK,
+    STATUS_BAD_REQUEST,
+    STATUS_NO_SESSION,
+    STATUS_FULL,
+    // Hit a bad opcode, restore a snapshot or destroy it
+    STATUS_FAULTED
+} DaemonStatus;
+
+// One image per distinct rom, dropped with its last session
+typedef struct RomImage {
+    Chip8Image* image;
+    uint64_t key;
+    uint16_t rom_size;
+    uint32_t users;
+    struct RomImage* next;
+} RomImage;
+
+typedef struct {
+    Chip8 chip;
+    RomImage* rom;
+    // Generation in the high half, arena index in the low half, 0 when free
+    uint32_t id;
+    uint16_t generation;
+    uint32_t owner;
+    bool faulted;
+    uint32_t next_free;
+} Session;
+
+// A step handed to the pool, lives in its client
+typedef struct {
+    Session* session;
+    uint32_t frames;
+    uint32_t cycles;
+    uint16_t keys;
+    bool faulted;
+    uint64_t hash;
+} Step;
+
+typedef struct {
+    // -1 when the slot is free
+    int fd;
+    uint8_t in[DAEMON_MAX_REQUEST];
+    size_t in_length;
+    uint8_t* out;
+    size_t out_length;
+    size_t out_capacity;
+    bool writing;
+    // A step is out on the pool, nothing else is read until it is back
+    bool busy;
+    // The peer went away while busy, finish closing when the step returns
+    bool closing;
+    Step step;
+} Client;
+
+typedef struct {
+    int epoll;
+    int listen;
+    int wake;
+    const char* path;
+
+    Session* sessions;
+    uint32_t session_count;
+    uint32_t free_session;
+    uint32_t live_sessions;
+    RomImage* images;
+
+    Client clients[DAEMON_MAX_CLIENTS];
+
+    // Client indices, each client has at most one step out so the rings never overflow
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    uint32_t queue[DAEMON_MAX_CLIENTS];
+    uint32_t queue_head;
+    uint32_t queue_length;
+    uint32_t done[DAEMON_MAX_CLIENTS];
+    uint32_t done_length;
+    bool quit;
+    pthread_t threads[DAEMON_MAX_THREADS];
+    uint32_t thread_count;
+
+    unsigned long created;
+    unsigned long steps;
+    unsigned long faults;
+} Daemon;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void Stop(int signal) {
+    (void)signal;
+    stopping = 1;
+}
+
+static uint32_t ReadU32(uint8_t const* bytes) {
+    return bytes[0] | (bytes[1] << 8u) | (bytes[2] << 16u) | ((uint32_t)bytes[3] << 24u);
+}
+
+static uint16_t ReadU16(uint8_t const* bytes) {
+    return bytes[0] | (bytes[1] << 8u);
+}
+
+static void WriteU32(uint8_t* bytes, uint32_t value) {
+    for (uint32_t i = 0; i < 4; ++i) {
+        bytes[i] = (value >> (8u * i)) & 0xFFu;
+    }
+}
+
+static void SetKeys(Chip8* chip, uint16_t keys) {
+    for (uint32_t i = 0; i < 16; ++i) {
+        chip->keypad[i] = (keys >> i) & 0x1u;
+    }
+}
+
+static void Watch(Daemon* daemon, int fd, uint32_t events, uint64_t tag, int op) {
+    struct epoll_event event = { .events = events, .data.u64 = tag };
+    if (epoll_ctl(daemon->epoll, op, fd, &event) < 0) {
+        error("epoll_ctl failed");
+    }
+}
+
+// Sessions
+
+static Session* FindSession(Daemon* daemon, uint32_t owner, uint32_t id) {
+    uint32_t index = id & 0xFFFFu;
+    if (index >= daemon->session_count) {
+        return NULL;
+    }
+    Session* session = &daemon->sessions[index];
+    return session->id == id && session->owner == owner ? session : NULL;
+}
+
+static Session* CreateSession(Daemon* daemon, uint32_t owner) {
+    if (daemon->free_session == UINT32_MAX) {
+        return NULL;
+    }
+
+    Session* session = &daemon->sessions[daemon->free_session];
+    daemon->free_session = session->next_free;
+    session->generation = session->generation == UINT16_MAX ? 1 : session->generation + 1;
+    session->id = ((uint32_t)session->generation << 16u) | (uint32_t)(session - daemon->sessions);
+    session->owner = owner;
+    session->faulted = false;
+    daemon->live_sessions += 1;
+    daemon->created += 1;
+    return session;
+}
+
+// FNV-1a, only to skip most compares
+static uint64_t RomKey(Rom const* rom) {
+    uint64_t key = 0xCBF29CE484222325ull;
+    for (uint16_t i = 0; i < rom->rom_size; ++i) {
+        key = (key ^ rom->memory[i]) * 0x100000001B3ull;
+    }
+    return key;
+}
+
+static RomImage* AcquireImage(Daemon* daemon, Rom const* rom) {
+    uint64_t key = RomKey(rom);
+    for (RomImage* entry = daemon->images; entry; entry = entry->next) {
+        if (entry->key == key && entry->rom_size == rom->rom_size &&
+            memcmp(&entry->image->memory[0x200], rom->memory, rom->rom_size) == 0) {
+            entry->users += 1;
+            return entry;
+        }
+    }
+
+    RomImage* entry = calloc(1, sizeof(RomImage));
+    if (!entry) {
+        error("Could not allocate a rom image");
+    }
+    entry->image = Chip8CreateImage(rom);
+    entry->key = key;
+    entry->rom_size = rom->rom_size;
+    entry->users = 1;
+    entry->next = daemon->images;
+    daemon->images = entry;
+    return entry;
+}
+
+static void ReleaseImage(Daemon* daemon, RomImage* image) {
+    if (--image->users) {
+        return;
+    }
+    RomImage** link = &daemon->images;
+    while (*link != image) {
+        link = &(*link)->next;
+    }
+    *link = image->next;
+    Chip8DestroyImage(&image->image);
+    free(image);
+}
+
+static void DestroySession(Daemon* daemon, Session* session) {
+    Chip8Release(&session->chip);
+    ReleaseImage(daemon, session->rom);
+    session->rom = NULL;
+    session->id = 0;
+    session->next_free = daemon->free_session;
+    daemon->free_session = session - daemon->sessions;
+    daemon->live_sessions -= 1;
+}
+
+// Stepping pool
+
+static void Recover(void* data) {
+    longjmp(*(jmp_buf*)data, 1);
+}
+
+static void RunStep(Step* step) {
+    Chip8* chip = &step->session->chip;
+    jmp_buf jump;
+
+    // error() on a bad opcode jumps back here, the machine is left as it was at that point
+    if (setjmp(jump)) {
+        step->faulted = true;
+        return;
+    }
+    SetErrorHandler(Recover, &jump);
+
+    SetKeys(chip, step->keys);
+    for (uint32_t frame = 0; frame < step->frames; ++frame) {
+        for (uint32_t cycle = 0; cycle < step->cycles; ++cycle) {
+            Chip8Cycle(chip);
+        }
+        Chip8TickTimers(chip);
+    }
+
+    SetErrorHandler(NULL, NULL);
+    step->hash = Chip8HashState(chip);
+}
+
+static void* Worker(void* data) {
+    Daemon* daemon = data;
+    uint64_t one = 1;
+
+    for (;;) {
+        pthread_mutex_lock(&daemon->lock);
+        while (!daemon->queue_length && !daemon->quit) {
+            pthread_cond_wait(&daemon->ready, &daemon->lock);
+        }
+        if (daemon->quit) {
+            pthread_mutex_unlock(&daemon->lock);
+            return NULL;
+        }
+        uint32_t index = daemon->queue[daemon->queue_head];
+        daemon->queue_head = (daemon->queue_head + 1) % DAEMON_MAX_CLIENTS;
+        daemon->queue_length -= 1;
+        pthread_mutex_unlock(&daemon->lock);
+
+        RunStep(&daemon->clients[index].step);
+
+        pthread_mutex_lock(&daemon->lock);
+        daemon->done[daemon->done_length++] = index;
+        pthread_mutex_unlock(&daemon->lock);
+        if (write(daemon->wake, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            error("Could not wake the event loop");
+        }
+    }
+}
+
+static void QueueStep(Daemon* daemon, uint32_t index) {
+    pthread_mutex_lock(&daemon->lock);
+    daemon->queue[(daemon->queue_head + daemon->queue_length) % DAEMON_MAX_CLIENTS] = index;
+    daemon->queue_length += 1;
+    pthread_cond_signal(&daemon->ready);
+    pthread_mutex_unlock(&daemon->lock);
+}
+
+// Connections
+
+static void CloseClient(Daemon* daemon, uint32_t index) {
+    Client* client = &daemon->clients[index];
+    if (!client->closing) {
+        epoll_ctl(daemon->epoll, EPOLL_CTL_DEL, client->fd, NULL);
+        close(client->fd);
+        client->closing = true;
+    }
+    // The pool still has one of its sessions, FinishStep comes back here
+    if (client->busy) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < daemon->session_count; ++i) {
+        Session* session = &daemon->sessions[i];
+        if (session->id && session->owner == index) {
+            DestroySession(daemon, session);
+        }
+    }
+    free(client->out);
+    memset(client, 0, sizeof(Client));
+    client->fd = -1;
+}
+
+static void Flush(Daemon* daemon, uint32_t index) {
+    Client* client = &daemon->clients[index];
+    size_t sent = 0;
+    while (sent < client->out_length) {
+        ssize_t count = send(client->fd, client->out + sent, client->out_length - sent, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (count <= 0) {
+            CloseClient(daemon, index);
+            return;
+        }
+        sent += count;
+    }
+
+    memmove(client->out, client->out + sent, client->out_length - sent);
+    client->out_length -= sent;
+
+    // Only ask for EPOLLOUT while something is stuck
+    bool writing = client->out_length > 0;
+    if (writing != client->writing) {
+        Watch(daemon, client->fd, EPOLLIN | (writing ? EPOLLOUT : 0), index, EPOLL_CTL_MOD);
+        client->writing = writing;
+    }
+}
+
+static void Respond(Client* client, DaemonStatus status, uint32_t session, void const* payload, uint32_t length) {
+    size_t needed = client->out_length + DAEMON_HEADER_SIZE + length;
+    if (needed > client->out_capacity) {
+        size_t capacity = client->out_capacity ? client->out_capacity : 4096;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        client->out = realloc(client->out, capacity);
+        if (!client->out) {
+            error("Could not allocate response buffer");
+        }
+        client->out_capacity = capacity;
+    }
+
+    uint8_t* out = client->out + client->out_length;
+    out[0] = status;
+    WriteU32(out + 1, session);
+    WriteU32(out + 5, length);
+    if (length) {
+        memcpy(out + DAEMON_HEADER_SIZE, payload, length);
+    }
+    client->out_length = needed;
+}
+
+static void RespondFrame(Client* client, Session const* session, uint64_t hash, bool with_hash) {
+    uint8_t payload[8 + CHIP8_VIDEO_BYTES];
+    for (uint32_t i = 0; i < 8; ++i) {
+        payload[i] = (hash >> (8u * i)) & 0xFFu;
+    }
+    Chip8PackVideo(&session->chip, payload + 8);
+    uint32_t skip = with_hash ? 0 : 8;
+    Respond(client, STATUS_OK, session->id, payload + skip, sizeof(payload) - skip);
+}
+
+// Handle one request, returns false once a step went out to the pool
+static bool HandleRequest(Daemon* daemon, uint32_t index, uint8_t op, uint32_t id, uint8_t const* payload, uint32_t length) {
+    Client* client = &daemon->clients[index];
+
+    if (op == 'C') {
+        if (length < 4 || length - 4 > CHIP8_MEMORY_SIZE - 0x200u) {
+            Respond(client, STATUS_BAD_REQUEST, 0, NULL, 0);
+            return true;
+        }
+        Session* session = CreateSession(daemon, index);
+        if (!session) {
+            Respond(client, STATUS_FULL, 0, NULL, 0);
+            return true;
+        }
+
+        Rom rom = { .memory = (uint8_t*)(uintptr_t)(payload + 4), .name = NULL, .rom_size = length - 4 };
+        session->rom = AcquireImage(daemon, &rom);
+        Chip8Init(&session->chip);
+        Chip8Seed(&session->chip, ReadU32(payload));
+        Chip8LoadImage(&session->chip, session->rom->image);
+        Respond(client, STATUS_OK, session->id, NULL, 0);
+        return true;
+    }
+
+    Session* session = FindSession(daemon, index, id);
+    if (!session) {
+        Respond(client, STATUS_NO_SESSION, id, NULL, 0);
+        return true;
+    }
+
+    switch (op) {
+        case 'S':
+            if (length != 10) {
+                break;
+            }
+            if ((uint64_t)ReadU32(payload) * ReadU32(payload + 4) > DAEMON_MAX_STEP) {
+                break;
+            }
+            if (session->faulted) {
+                Respond(client, STATUS_FAULTED, id, NULL, 0);
+                return true;
+            }
+            client->step = (Step){ .session = session, .frames = ReadU32(payload), .cycles = ReadU32(payload + 4),
+                                   .keys = ReadU16(payload + 8) };
+            client->busy = true;
+            daemon->steps += 1;
+            QueueStep(daemon, index);
+            return false;
+
+        case 'K':
+            if (length != 2) {
+                break;
+            }
+            SetKeys(&session->chip, ReadU16(payload));
+            Respond(client, STATUS_OK, id, NULL, 0);
+            return true;
+
+        case 'G': {
+            Chip8State state;
+            Chip8SaveState(&session->chip, &state);
+            Respond(client, STATUS_OK, id, &state, sizeof(state));
+            return true;
+        }
+
+        case 'P': {
+            if (length != sizeof(Chip8State)) {
+                break;
+            }
+            Chip8State state;
+            memcpy(&state, payload, sizeof(state));
+            Chip8LoadState(&session->chip, &state);
+            session->faulted = false;
+            Respond(client, STATUS_OK, id, NULL, 0);
+            return true;
+        }
+
+        case 'V':
+            RespondFrame(client, session, 0, false);
+            return true;
+
+        case 'D':
+            DestroySession(daemon, session);
+            Respond(client, STATUS_OK, id, NULL, 0);
+            return true;
+
+        default:
+            break;
+    }
+
+    Respond(client, STATUS_BAD_REQUEST, id, NULL, 0);
+    return true;
+}
+
+// Answer every complete request that is buffered, stopping at a step
+static void HandleRequests(Daemon* daemon, uint32_t index) {
+    Client* client = &daemon->clients[index];
+    size_t used = 0;
+
+    while (client->in_length - used >= DAEMON_HEADER_SIZE) {
+        uint8_t const* header = client->in + used;
+        uint32_t length = ReadU32(header + 5);
+        if (length > DAEMON_MAX_REQUEST - DAEMON_HEADER_SIZE) {
+            CloseClient(daemon, index);
+            return;
+        }
+        if (client->in_length - used < DAEMON_HEADER_SIZE + length) {
+            break;
+        }
+
+        used += DAEMON_HEADER_SIZE + length;
+        if (!HandleRequest(daemon, index, header[0], ReadU32(header + 1), header + DAEMON_HEADER_SIZE, length)) {
+            break;
+        }
+    }
+
+    memmove(client->in, client->in + used, client->in_length - used);
+    client->in_length -= used;
+    Flush(daemon, index);
+}
+
+static void ReadClient(Daemon* daemon, uint32_t index) {
+    Client* client = &daemon->clients[index];
+
+    // A busy client is not read, its bytes wait in the socket until the step is back
+    while (!client->busy && !client->closing && client->in_length < sizeof(client->in)) {
+        ssize_t count = recv(client->fd, client->in + client->in_length, sizeof(client->in) - client->in_length, 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (count <= 0) {
+            CloseClient(daemon, index);
+            return;
+        }
+
+        client->in_length += count;
+        HandleRequests(daemon, index);
+        if (client->fd < 0) {
+            // Closed while handling, the slot is free
+            return;
+        }
+        if (client->out_length > DAEMON_MAX_OUTPUT) {
+            CloseClient(daemon, index);
+            return;
+        }
+    }
+}
+
+static void FinishStep(Daemon* daemon, uint32_t index) {
+    Client* client = &daemon->clients[index];
+    Step* step = &client->step;
+    client->busy = false;
+
+    if (client->closing) {
+        CloseClient(daemon, index);
+        return;
+    }
+
+    if (step->faulted) {
+        step->session->faulted = true;
+        daemon->faults += 1;
+        Respond(client, STATUS_FAULTED, step->session->id, NULL, 0);
+    } else {
+        RespondFrame(client, step->session, step->hash, true);
+    }
+
+    // Requests that piled up behind the step, then whatever is left in the socket
+    HandleRequests(daemon, index);
+    if (client->fd >= 0) {
+        ReadClient(daemon, index);
+    }
+}
+
+static void Accept(Daemon* daemon) {
+    for (;;) {
+        int fd = accept(daemon->listen, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            close(fd);
+            continue;
+        }
+
+        uint32_t index = 0;
+        while (index < DAEMON_MAX_CLIENTS && daemon->clients[index].fd >= 0) {
+            index += 1;
+        }
+        if (index == DAEMON_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+
+        daemon->clients[index].fd = fd;
+        Watch(daemon, fd, EPOLLIN, index, EPOLL_CTL_ADD);
+    }
+}
+
+static void Wake(Daemon* daemon) {
+    uint64_t count;
+    if (read(daemon->wake, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        error("Could not read the wake eventfd");
+    }
+
+    uint32_t done[DAEMON_MAX_CLIENTS];
+    pthread_mutex_lock(&daemon->lock);
+    uint32_t length = daemon->done_length;
+    memcpy(done, daemon->done, sizeof(uint32_t) * length);
+    daemon->done_length = 0;
+    pthread_mutex_unlock(&daemon->lock);
+
+    for (uint32_t i = 0; i < length; ++i) {
+        FinishStep(daemon, done[i]);
+    }
+}
+
+static void OpenDaemon(Daemon* daemon, const char* path, uint32_t threads, uint32_t sessions) {
+    memset(daemon, 0, sizeof(Daemon));
+    daemon->path = path;
+    for (uint32_t i = 0; i < DAEMON_MAX_CLIENTS; ++i) {
+        daemon->clients[i].fd = -1;
+    }
+
+    // One allocation for every session, never touched again until destroyed
+    daemon->sessions = calloc(sessions, sizeof(Session));
+    if (!daemon->sessions) {
+        error("Could not allocate the session arena");
+    }
+    daemon->session_count = sessions;
+    for (uint32_t i = 0; i < sessions; ++i) {
+        daemon->sessions[i].next_free = i + 1 < sessions ? i + 1 : UINT32_MAX;
+    }
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        error("Socket path too long");
+    }
+    strcpy(address.sun_path, path);
+    // Only clear a stale socket, never some other file at a mistyped path
+    struct stat existing;
+    if (lstat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(path);
+    }
+
+    daemon->listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (daemon->listen < 0 || bind(daemon->listen, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+        listen(daemon->listen, 128) < 0) {
+        error("Could not listen on the socket");
+    }
+
+    daemon->epoll = epoll_create1(EPOLL_CLOEXEC);
+    daemon->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (daemon->epoll < 0 || daemon->wake < 0) {
+        error("Could not create the event loop");
+    }
+    Watch(daemon, daemon->listen, EPOLLIN, TAG_LISTEN, EPOLL_CTL_ADD);
+    Watch(daemon, daemon->wake, EPOLLIN, TAG_WAKE, EPOLL_CTL_ADD);
+
+    pthread_mutex_init(&daemon->lock, NULL);
+    pthread_cond_init(&daemon->ready, NULL);
+    daemon->thread_count = threads;
+    for (uint32_t i = 0; i < threads; ++i) {
+        if (pthread_create(&daemon->threads[i], NULL, Worker, daemon) != 0) {
+            error("Could not start worker threads");
+        }
+    }
+}
+
+static void CloseDaemon(Daemon* daemon) {
+    pthread_mutex_lock(&daemon->lock);
+    daemon->quit = true;
+    pthread_cond_broadcast(&daemon->ready);
+    pthread_mutex_unlock(&daemon->lock);
+    for (uint32_t i = 0; i < daemon->thread_count; ++i) {
+        pthread_join(daemon->threads[i], NULL);
+    }
+
+    fprintf(stderr, "[CHIPPYD] %lu sessions created, %lu steps, %lu faults\n", daemon->created, daemon->steps,
+            daemon->faults);
+
+    for (uint32_t i = 0; i < DAEMON_MAX_CLIENTS; ++i) {
+        if (daemon->clients[i].fd >= 0) {
+            close(daemon->clients[i].fd);
+            free(daemon->clients[i].out);
+        }
+    }
+    close(daemon->listen);
+    close(daemon->wake);
+    close(daemon->epoll);
+    unlink(daemon->path);
+    pthread_mutex_destroy(&daemon->lock);
+    pthread_cond_destroy(&daemon->ready);
+    for (uint32_t i = 0; i < daemon->session_count; ++i) {
+        if (daemon->sessions[i].id) {
+            DestroySession(daemon, &daemon->sessions[i]);
+        }
+    }
+    free(daemon->sessions);
+}
+
+static unsigned long Number(const char* text) {
+    char* end = NULL;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || *end != '\0') {
+        error(USAGE);
+    }
+    return value;
+}
+
+int main(int argc, char** argv) {
+    const char* path = "/tmp/chippyd.sock";
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long threads = cores > 0 ? (unsigned long)cores : 1;
+    unsigned long sessions = 1024;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--socket=", 9) == 0) {
+            path = argv[i] + 9;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = Number(argv[i] + 10);
+        } else if (strncmp(argv[i], "--max-sessions=", 15) == 0) {
+            sessions = Number(argv[i] + 15);
+        } else {
+            error(USAGE);
+        }
+    }
+    if (threads == 0 || sessions == 0 || sessions > UINT16_MAX) {
+        error(USAGE);
+    }
+    if (threads > DAEMON_MAX_THREADS) {
+        threads = DAEMON_MAX_THREADS;
+    }
+
+    // Daemons are large, keep it off the stack
+    static Daemon daemon;
+    OpenDaemon(&daemon, path, threads, sessions);
+
+    struct sigaction action = { .sa_handler = Stop };
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    struct epoll_event events[64];
+    while (!stopping) {
+        int count = epoll_wait(daemon.epoll, events, 64, -1);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            error("epoll_wait failed");
+        }
+
+        for (int i = 0; i < count; ++i) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == TAG_LISTEN) {
+                Accept(&daemon);
+            } else if (tag == TAG_WAKE) {
+                Wake(&daemon);
+            } else if (daemon.clients[tag].fd >= 0 && !daemon.clients[tag].closing) {
+                if (events[i].events & EPOLLOUT) {
+                    Flush(&daemon, tag);
+                }
+                if (daemon.clients[tag].fd >= 0 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                    ReadClient(&daemon, tag);
+                }
+            }
+        }
+    }
+
+    CloseDaemon(&daemon);
+    return EXIT_SUCCESS;
+}
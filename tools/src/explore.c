@@ -0,0 +1,300 @@
+/*
+    chippy-explore, breadth first search over every reachable state of a rom
+
+    Usage: chippy-explore [--depth=N] [--threads=N] [--ipf=N] [--max-frontier=N] [--max-visited=N] <rom>
+
+    Every state in the frontier is forked once per input (no key, or one of the
+    16 keys held) and run for one 60Hz frame. Results are hashed and dropped if
+    the hash was seen before, survivors make the next frontier. Memory is bounded
+    by --max-frontier compact states per level and --max-visited hashes.
+*/
+
+#include "chip8.h"
+#include "rom.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+static const char* USAGE =
+    "Usage: chippy-explore [--depth=N] [--threads=N] [--ipf=N] [--max-frontier=N] [--max-visited=N] <rom>\n";
+
+// No key plus each of the 16 keys
+enum { INPUTS = 17, CHUNK = 16 };
+
+/* Lock free set of 64 bit hashes, open addressing, 0 marks an empty slot */
+typedef struct {
+    _Atomic uint64_t* slots;
+    size_t mask;
+    atomic_size_t count;
+    size_t limit;
+} HashSet;
+
+static void InitHashSet(HashSet* set, size_t limit) {
+    size_t size = 1;
+    while (size < limit * 2) {
+        size <<= 1u;
+    }
+
+    set->slots = calloc(size, sizeof(uint64_t));
+    if (!set->slots) {
+        error("Could not allocate hash set");
+    }
+    set->mask = size - 1;
+    set->limit = limit;
+    atomic_init(&set->count, 0);
+}
+
+static void DestroyHashSet(HashSet* set) {
+    free((void*)(uintptr_t)set->slots);
+    set->slots = NULL;
+}
+
+// Returns true if hash was not in the set yet. A full set reports everything as seen
+static bool HashSetInsert(HashSet* set, uint64_t hash) {
+    hash = hash ? hash : 1;
+
+    if (atomic_load_explicit(&set->count, memory_order_relaxed) >= set->limit) {
+        return false;
+    }
+
+    for (size_t i = hash & set->mask;; i = (i + 1) & set->mask) {
+        uint64_t current = atomic_load_explicit(&set->slots[i], memory_order_relaxed);
+        if (current == hash) {
+            return false;
+        }
+        if (current == 0) {
+            uint64_t expected = 0;
+            if (atomic_compare_exchange_strong(&set->slots[i], &expected, hash)) {
+                atomic_fetch_add_explicit(&set->count, 1, memory_order_relaxed);
+                return true;
+            }
+            if (expected == hash) {
+                return false;
+            }
+        }
+    }
+}
+
+typedef struct {
+    Chip8State* current;
+    size_t current_count;
+    atomic_size_t next_chunk;
+
+    Chip8State* next;
+    size_t next_limit;
+    atomic_size_t next_count;
+    atomic_size_t dropped;
+
+    HashSet states;
+    HashSet screens;
+    int cycles_per_frame;
+
+    // Pcs any thread has executed, merged from the workers after each level
+    uint64_t coverage[CHIP8_MEMORY_SIZE / 64];
+    pthread_mutex_t lock;
+} Explorer;
+
+static void* Worker(void* data) {
+    Explorer* explorer = data;
+    uint64_t coverage[CHIP8_MEMORY_SIZE / 64] = { 0 };
+
+    Chip8* chip = malloc(sizeof(Chip8));
+    if (!chip) {
+        error("Could not allocate worker state");
+    }
+    Chip8Init(chip);
+
+    for (;;) {
+        size_t start = atomic_fetch_add(&explorer->next_chunk, CHUNK);
+        if (start >= explorer->current_count) {
+            break;
+        }
+        size_t end = start + CHUNK < explorer->current_count ? start + CHUNK : explorer->current_count;
+
+        for (size_t i = start; i < end; ++i) {
+            for (int input = 0; input < INPUTS; ++input) {
+                Chip8LoadState(chip, &explorer->current[i]);
+                memset(chip->keypad, 0, sizeof(chip->keypad));
+                if (input > 0) {
+                    chip->keypad[input - 1] = 1;
+                }
+
+                // Single step so every pc executed is seen
+                for (int cycle = 0; cycle < explorer->cycles_per_frame; ++cycle) {
+                    uint16_t pc = chip->pc & (CHIP8_MEMORY_SIZE - 1);
+                    coverage[pc / 64] |= (uint64_t)1 << (pc % 64);
+                    Chip8Cycle(chip);
+                }
+                Chip8TickTimers(chip);
+
+                if (!HashSetInsert(&explorer->states, Chip8HashState(chip))) {
+                    continue;
+                }
+
+                uint8_t screen[CHIP8_VIDEO_BYTES];
+                Chip8PackVideo(chip, screen);
+                uint64_t screen_hash = 0xCBF29CE484222325ull;
+                for (size_t b = 0; b < CHIP8_VIDEO_BYTES; ++b) {
+                    screen_hash = (screen_hash ^ screen[b]) * 0x100000001B3ull;
+                }
+                HashSetInsert(&explorer->screens, screen_hash);
+
+                size_t slot = atomic_fetch_add(&explorer->next_count, 1);
+                if (slot < explorer->next_limit) {
+                    Chip8SaveState(chip, &explorer->next[slot]);
+                } else {
+                    atomic_fetch_add(&explorer->dropped, 1);
+                }
+            }
+        }
+    }
+
+    pthread_mutex_lock(&explorer->lock);
+    for (size_t i = 0; i < CHIP8_MEMORY_SIZE / 64; ++i) {
+        explorer->coverage[i] |= coverage[i];
+    }
+    pthread_mutex_unlock(&explorer->lock);
+
+    Chip8Release(chip);
+    free(chip);
+    return NULL;
+}
+
+static size_t CountBits(uint64_t const* bitmap, size_t words) {
+    size_t count = 0;
+    for (size_t i = 0; i < words; ++i) {
+        for (uint64_t word = bitmap[i]; word; word &= word - 1) {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+static double Now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static unsigned long Number(const char* text) {
+    char* end = NULL;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || *end != '\0' || value == 0) {
+        error(USAGE);
+    }
+    return value;
+}
+
+int main(int argc, char** argv) {
+    unsigned long depth = 60;
+    unsigned long threads = 4;
+    unsigned long cycles_per_frame = 10;
+    unsigned long max_frontier = 20000;
+    unsigned long max_visited = 1ul << 22u;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--depth=", 8) == 0) {
+            depth = Number(argv[i] + 8);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = Number(argv[i] + 10);
+        } else if (strncmp(argv[i], "--ipf=", 6) == 0) {
+            cycles_per_frame = Number(argv[i] + 6);
+        } else if (strncmp(argv[i], "--max-frontier=", 15) == 0) {
+            max_frontier = Number(argv[i] + 15);
+        } else if (strncmp(argv[i], "--max-visited=", 14) == 0) {
+            max_visited = Number(argv[i] + 14);
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            error(USAGE);
+        }
+    }
+    if (!path) {
+        error(USAGE);
+    }
+
+    Rom* rom = LoadRom(path);
+    if (!rom) {
+        error("Could not load rom");
+    }
+
+    Explorer explorer;
+    memset(&explorer, 0, sizeof(Explorer));
+    explorer.cycles_per_frame = cycles_per_frame;
+    explorer.next_limit = max_frontier;
+    pthread_mutex_init(&explorer.lock, NULL);
+    InitHashSet(&explorer.states, max_visited);
+    InitHashSet(&explorer.screens, max_visited);
+
+    explorer.current = malloc(sizeof(Chip8State) * max_frontier);
+    explorer.next = malloc(sizeof(Chip8State) * max_frontier);
+    pthread_t* workers = malloc(sizeof(pthread_t) * threads);
+    Chip8* root = malloc(sizeof(Chip8));
+    if (!explorer.current || !explorer.next || !workers || !root) {
+        error("Could not allocate frontier");
+    }
+
+    // Fixed seed so a run is reproducible
+    Chip8Init(root);
+    Chip8Seed(root, 1);
+    Chip8LoadRom(root, rom);
+    Chip8SaveState(root, &explorer.current[0]);
+    explorer.current_count = 1;
+    HashSetInsert(&explorer.states, Chip8HashState(root));
+
+    printf("%5s %10s %10s %10s %8s %6s %12s\n", "depth", "frontier", "states", "screens", "dropped", "pcs", "states/s");
+    double start = Now();
+
+    for (unsigned long level = 1; level <= depth && explorer.current_count > 0; ++level) {
+        double level_start = Now();
+        atomic_store(&explorer.next_chunk, 0);
+        atomic_store(&explorer.next_count, 0);
+
+        for (unsigned long t = 0; t < threads; ++t) {
+            if (pthread_create(&workers[t], NULL, Worker, &explorer) != 0) {
+                error("Could not start worker thread");
+            }
+        }
+        for (unsigned long t = 0; t < threads; ++t) {
+            pthread_join(workers[t], NULL);
+        }
+
+        size_t produced = atomic_load(&explorer.next_count);
+        size_t kept = produced < explorer.next_limit ? produced : explorer.next_limit;
+        double elapsed = Now() - level_start;
+
+        printf("%5lu %10zu %10zu %10zu %8zu %6zu %12.0f\n", level, kept, atomic_load(&explorer.states.count),
+               atomic_load(&explorer.screens.count), atomic_load(&explorer.dropped),
+               CountBits(explorer.coverage, CHIP8_MEMORY_SIZE / 64),
+               elapsed > 0 ? explorer.current_count * INPUTS / elapsed : 0.0);
+
+        Chip8State* swap = explorer.current;
+        explorer.current = explorer.next;
+        explorer.next = swap;
+        explorer.current_count = kept;
+    }
+
+    double total = Now() - start;
+    printf("%.2fs, %zu states, %zu screens (%.0f screens/s), %zu pcs covered\n", total,
+           atomic_load(&explorer.states.count), atomic_load(&explorer.screens.count),
+           total > 0 ? atomic_load(&explorer.screens.count) / total : 0.0,
+           CountBits(explorer.coverage, CHIP8_MEMORY_SIZE / 64));
+
+    Chip8Release(root);
+    free(root);
+    free(workers);
+    free(explorer.current);
+    free(explorer.next);
+    DestroyHashSet(&explorer.states);
+    DestroyHashSet(&explorer.screens);
+    pthread_mutex_destroy(&explorer.lock);
+    DestroyRom(&rom);
+    return EXIT_SUCCESS;
+}
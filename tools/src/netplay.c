@@ -0,0 +1,168 @@
+/*
+    chippy-netplay, loopback harness for rollback netplay
+
+    Usage: chippy-netplay [--frames=N] [--delay=MS] [--loss=PERCENT] [--ipf=N] [--port=N] <rom>
+
+    Runs both players in one process over 127.0.0.1 at 60Hz with scripted keys,
+    the given delay and loss injected on every packet. When both sides have all
+    inputs their machines must match each other and a plain run with the same
+    keys. Exits non zero on any mismatch.
+*/
+
+#include "chip8.h"
+#include "rom.h"
+#include "error.h"
+#include "netplay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char* USAGE = "Usage: chippy-netplay [--frames=N] [--delay=MS] [--loss=PERCENT] [--ipf=N] [--port=N] <rom>\n";
+
+// Holds one key (or none) for a while, different for each player
+static uint16_t ScriptKeys(uint32_t player, uint32_t frame) {
+    uint32_t x = (frame / 23 + 1) * 0x9E3779B1u ^ (player + 1) * 0x85EBCA6Bu;
+    x ^= x >> 15u;
+    x *= 0x2C1B3C6Du;
+    x ^= x >> 12u;
+
+    uint32_t key = x % 20;
+    return key < 16 ? 1u << key : 0;
+}
+
+static void SetKeys(uint8_t* keys, uint16_t mask) {
+    for (int i = 0; i < 16; ++i) {
+        keys[i] = (mask >> i) & 0x1u;
+    }
+}
+
+static double Seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static unsigned long Number(const char* text) {
+    char* end = NULL;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || *end != '\0') {
+        error(USAGE);
+    }
+    return value;
+}
+
+int main(int argc, char** argv) {
+    unsigned long frames = 600;
+    unsigned long delay = 50;
+    unsigned long loss = 10;
+    unsigned long cycles = 10;
+    unsigned long port = 47600;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--frames=", 9) == 0) {
+            frames = Number(argv[i] + 9);
+        } else if (strncmp(argv[i], "--delay=", 8) == 0) {
+            delay = Number(argv[i] + 8);
+        } else if (strncmp(argv[i], "--loss=", 7) == 0) {
+            loss = Number(argv[i] + 7);
+        } else if (strncmp(argv[i], "--ipf=", 6) == 0) {
+            cycles = Number(argv[i] + 6);
+        } else if (strncmp(argv[i], "--port=", 7) == 0) {
+            port = Number(argv[i] + 7);
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            error(USAGE);
+        }
+    }
+    if (!path || port == 0 || port > 0xFFFE) {
+        error(USAGE);
+    }
+
+    Rom* rom = LoadRom(path);
+    if (!rom) {
+        error("Could not load rom");
+    }
+
+    static Chip8 chips[2];
+    static Chip8 reference;
+    Netplay players[2];
+
+    for (uint32_t player = 0; player < 2; ++player) {
+        char address[64];
+        snprintf(address, sizeof(address), "%lu:127.0.0.1:%lu", port + player, port + 1 - player);
+        OpenNetplay(&players[player], address);
+        SetNetplayConditions(&players[player], delay, loss);
+
+        Chip8Init(&chips[player]);
+        Chip8Seed(&chips[player], NETPLAY_SEED);
+        Chip8LoadRom(&chips[player], rom);
+    }
+
+    // Each side runs up to where the clock says it should be, like the gui does
+    double start = Seconds();
+    double worst = 0;
+    while (players[0].frame < frames || players[1].frame < frames) {
+        uint32_t due = (Seconds() - start) * 60.0;
+        due = due < frames ? due + 1 : frames;
+
+        for (uint32_t player = 0; player < 2; ++player) {
+            Netplay* netplay = &players[player];
+            while (netplay->frame < due) {
+                SetKeys(netplay->keys, ScriptKeys(player, netplay->frame));
+                double before = Seconds();
+                bool advanced = NetplayAdvance(netplay, &chips[player], cycles);
+                if (Seconds() - before > worst) {
+                    worst = Seconds() - before;
+                }
+                if (!advanced) {
+                    break;
+                }
+            }
+            NetplayPoll(netplay, &chips[player], cycles);
+        }
+
+        struct timespec pause = { .tv_nsec = 1000000 };
+        nanosleep(&pause, NULL);
+    }
+
+    // Keep exchanging until both have every remote input, resending what got lost
+    double deadline = Seconds() + 5.0;
+    while ((players[0].remote_frames < frames || players[1].remote_frames < frames) && Seconds() < deadline) {
+        for (uint32_t player = 0; player < 2; ++player) {
+            NetplayPoll(&players[player], &chips[player], cycles);
+        }
+
+        struct timespec pause = { .tv_nsec = 1000000 };
+        nanosleep(&pause, NULL);
+    }
+
+    Chip8Init(&reference);
+    Chip8Seed(&reference, NETPLAY_SEED);
+    Chip8LoadRom(&reference, rom);
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        SetKeys(reference.keypad, ScriptKeys(0, frame) | ScriptKeys(1, frame));
+        for (uint32_t cycle = 0; cycle < cycles; ++cycle) {
+            Chip8Cycle(&reference);
+        }
+        Chip8TickTimers(&reference);
+    }
+
+    uint64_t expected = Chip8HashState(&reference);
+    bool ok = true;
+    for (uint32_t player = 0; player < 2; ++player) {
+        uint64_t hash = Chip8HashState(&chips[player]);
+        bool match = hash == expected && players[player].frame == frames && players[player].remote_frames >= frames;
+        printf("player %u: frame %u, hash %016llx %s\n", (unsigned)player + 1, (unsigned)players[player].frame,
+               (unsigned long long)hash, match ? "ok" : "MISMATCH");
+        ok = ok && match && players[player].desyncs == 0;
+        CloseNetplay(&players[player]);
+    }
+    printf("reference hash %016llx, slowest frame %.2fms\n", (unsigned long long)expected, worst * 1000.0);
+
+    DestroyRom(&rom);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,110 @@
+/*
+    chippy-peek, follow a running chippy --shm=/NAME from another process
+
+    Usage: chippy-peek [--frames=N] [--keys=HEX] /NAME
+        --frames=N  follow N frames then print the last one (default 60)
+        --keys=HEX  hold these keys (bit n for key n) while following, released at exit
+
+    Reads every frame as it is published and counts the ones that were
+    overwritten before it got to them, a check that a reader keeps up.
+*/
+
+#include "shared.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char* USAGE = "Usage: chippy-peek [--frames=N] [--keys=HEX] /NAME\n";
+
+static void Pause(void) {
+    struct timespec pause = { .tv_nsec = 500000 };
+    nanosleep(&pause, NULL);
+}
+
+static void PrintFrame(SharedSlot const* slot) {
+    printf("frame %llu pc=%03X I=%03X sp=%X dt=%02X st=%02X keys=%04X\n", (unsigned long long)slot->frame,
+           slot->pc, slot->index, slot->sp, slot->delay_timer, slot->sound_timer, slot->keypad);
+    for (uint32_t i = 0; i < 16; ++i) {
+        printf("V%X=%02X%s", i, slot->registers[i], (i % 8 == 7) ? "\n" : " ");
+    }
+    for (uint32_t y = 0; y < CHIP8_VIDEO_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < CHIP8_VIDEO_WIDTH; ++x) {
+            putchar(slot->pixels[y * CHIP8_VIDEO_WIDTH + x] ? '#' : '.');
+        }
+        putchar('\n');
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned long frames = 60;
+    unsigned long keys = 0;
+    const char* name = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--frames=", 9) == 0) {
+            frames = strtoul(argv[i] + 9, NULL, 10);
+        } else if (strncmp(argv[i], "--keys=", 7) == 0) {
+            keys = strtoul(argv[i] + 7, NULL, 16);
+        } else if (!name && argv[i][0] == '/') {
+            name = argv[i];
+        } else {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!name || frames == 0) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+
+    SharedFrames shared;
+    if (!AttachSharedFrames(&shared, name)) {
+        fprintf(stderr, "[ERROR] No chippy shared memory at %s\n", name);
+        return EXIT_FAILURE;
+    }
+    atomic_store(&shared.header->keys, keys & 0xFFFFu);
+
+    SharedSlot slot;
+    bool have = false;
+    unsigned long read = 0;
+    unsigned long missed = 0;
+    uint64_t next = atomic_load_explicit(&shared.header->frame, memory_order_acquire) + 1;
+
+    // Give up once the emulator has published nothing for 5s
+    unsigned long idle = 0;
+    while (read < frames && idle < 10000) {
+        uint64_t latest = atomic_load_explicit(&shared.header->frame, memory_order_acquire);
+        if (latest < next) {
+            idle += 1;
+            Pause();
+            continue;
+        }
+        idle = 0;
+
+        // Frames further back than the ring are gone already
+        uint64_t oldest = latest >= shared.header->slot_count ? latest - shared.header->slot_count + 1 : 1;
+        if (next < oldest) {
+            missed += oldest - next;
+            next = oldest;
+        }
+
+        if (SharedReadFrame(&shared, next, &slot)) {
+            read += 1;
+            have = true;
+        } else {
+            missed += 1;
+        }
+        next += 1;
+    }
+
+    atomic_store(&shared.header->keys, 0);
+    if (have) {
+        PrintFrame(&slot);
+    }
+    printf("%lu frames read, %lu overwritten before they were read\n", read, missed);
+
+    DetachSharedFrames(&shared);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*
+    chippy-trace, decode a trace written by chippy --trace
+
+    Usage: chippy-trace [--from=ADDR] [--to=ADDR] [--last=N] <trace>
+        --from/--to  only instructions with pc in [from, to] (hex)
+        --last=N     print the last N matching instructions (default 32, 0 for all)
+*/
+
+#include "trace.h"
+#include "disassembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* USAGE = "Usage: chippy-trace [--from=ADDR] [--to=ADDR] [--last=N] <trace>\n";
+
+static uint32_t ReadU32(uint8_t const* bytes) {
+    return bytes[0] | (bytes[1] << 8u) | (bytes[2] << 16u) | ((uint32_t)bytes[3] << 24u);
+}
+
+static uint16_t ReadU16(uint8_t const* bytes) {
+    return bytes[0] | (bytes[1] << 8u);
+}
+
+static int Fail(const char* msg) {
+    fprintf(stderr, "[ERROR] %s\n", msg);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char** argv) {
+    unsigned long from = 0;
+    unsigned long to = CHIP8_MEMORY_SIZE - 1;
+    unsigned long last = 32;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--from=", 7) == 0) {
+            from = strtoul(argv[i] + 7, NULL, 16);
+        } else if (strncmp(argv[i], "--to=", 5) == 0) {
+            to = strtoul(argv[i] + 5, NULL, 16);
+        } else if (strncmp(argv[i], "--last=", 7) == 0) {
+            last = strtoul(argv[i] + 7, NULL, 10);
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!path) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return Fail("Could not open trace");
+    }
+
+    uint8_t header[20];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, "CH8T", 4) != 0) {
+        fclose(file);
+        return Fail("Not a chippy trace");
+    }
+
+    uint32_t record_size = ReadU32(&header[4]);
+    uint64_t executed = ReadU32(&header[8]) | ((uint64_t)ReadU32(&header[12]) << 32u);
+    uint32_t count = ReadU32(&header[16]);
+    if (record_size != 8) {
+        fclose(file);
+        return Fail("Unsupported trace record size");
+    }
+
+    TraceRecord* records = malloc(sizeof(TraceRecord) * (count ? count : 1));
+    uint32_t* matches = malloc(sizeof(uint32_t) * (count ? count : 1));
+    if (!records || !matches) {
+        fclose(file);
+        return Fail("Out of memory");
+    }
+
+    uint32_t matched = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t bytes[8];
+        if (fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) {
+            count = i;
+            fprintf(stderr, "[WARN] Trace is truncated after %u records\n", (unsigned)count);
+            break;
+        }
+
+        records[i].pc = ReadU16(&bytes[0]);
+        records[i].opcode = ReadU16(&bytes[2]);
+        records[i].index = ReadU16(&bytes[4]);
+        records[i].reg = bytes[6];
+        records[i].value = bytes[7];
+
+        if (records[i].pc >= from && records[i].pc <= to) {
+            matches[matched++] = i;
+        }
+    }
+    fclose(file);
+
+    printf("%llu instructions executed, %u in trace, %u match\n", (unsigned long long)executed, (unsigned)count, (unsigned)matched);
+
+    uint32_t start = (last && matched > last) ? matched - last : 0;
+    uint64_t first = executed - count;
+
+    for (uint32_t i = start; i < matched; ++i) {
+        TraceRecord const* record = &records[matches[i]];
+        char text[32];
+        Disassemble(record->opcode, text, sizeof(text));
+
+        printf("%10llu  0x%03X  %04X  %-18s I=%03X", (unsigned long long)(first + matches[i]), record->pc, record->opcode, text, record->index);
+        if (record->reg != TRACE_NO_REGISTER) {
+            printf("  V%X=%02X", record->reg, record->value);
+        }
+        printf("\n");
+    }
+
+    free(records);
+    free(matches);
+    return EXIT_SUCCESS;
+}